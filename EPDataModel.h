@@ -0,0 +1,159 @@
+// ============================================================================
+// EPDataModel.h
+//
+// Data classes written to and read from ROOT trees by all steps of the
+// analysis (LHCb Pb+Pb 2024):
+//
+// - QVectorEvent: step-1 Q-vector tuple (EventPlaneAnalysis, read by
+//   calculateEventPlane and EventPlaneCalculator.h)
+// - EventPlane:   step-2 EP file (calculateEventPlane, read by step 3)
+// - Event, Lambda, Daughter: step-3 output (GlobalPolarizationAnalysis_FilePrep)
+//
+// The dictionaries are compiled once into a shared library together with
+// the schema-evolution rules of EPDataModel_linkdef.h; rootlogon.C builds
+// (if needed) and loads it at start-up, so the macros do not generate
+// dictionaries of their own and every step uses the same on-disk layout.
+//
+// The classes carry a class version (ClassDefNV: no virtual table, so the
+// in-memory layout is unchanged). Version 1 is the layout written before the
+// classes were versioned; change a member → increase the version.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef EPDataModel_h
+#define EPDataModel_h
+
+#include <Rtypes.h>
+
+// ============================================================================
+// Step-1 output of one selected event: Q-vectors and event information
+// ============================================================================
+// Written as the split "event" branch of EventPlaneTuple. Files written
+// before this class existed store it as class "Event" (read rule in
+// EPDataModel_linkdef.h).
+class QVectorEvent {
+public:
+    // General event information
+    ULong64_t outGPSTIME;
+    ULong64_t outEVENTNUMBER;
+    Float_t   outPVX;
+    Float_t   outPVY;
+    Float_t   outPVZ;
+    UInt_t    outRUNNUMBER;
+
+    // Global multiplicities
+    Int_t     outnBackTracks;
+    Int_t     outnVeloClusters;
+    Int_t     outnVeloTracks;
+    Int_t     outnEcalClusters;
+    Int_t     outECalETot;
+    Int_t     outnLongTracks;
+    Int_t     outnVPClusters;
+
+    // Q-vectors (harmonic orders 1 and 2)
+    Double_t  outQx_back[2];
+    Double_t  outQy_back[2];
+    Double_t  outQx_for[2][4];      // 4 eta bins
+    Double_t  outQy_for[2][4];
+
+    // Q-vectors with eta weight
+    Double_t  outQx_back_wEta[2];
+    Double_t  outQy_back_wEta[2];
+    Double_t  outQx_for_wEta[2][4];
+    Double_t  outQy_for_wEta[2][4];
+
+    // Tracks in forward eta bins 1-3 and backward
+    Int_t     out_Qmulti[4];
+
+    QVectorEvent() : outGPSTIME(0), outEVENTNUMBER(0), outRUNNUMBER(0) {}
+
+    ClassDefNV(QVectorEvent, 2);
+};
+
+// ============================================================================
+// Class storing event plane information matched by (RUNNUMBER, EVENTNUMBER)
+// ============================================================================
+class EventPlane {
+public:
+    ULong64_t EVENTNUMBER;   // Unique event ID
+    UInt_t    RUNNUMBER;     // Run ID
+    Double_t  Psi1Full;      // Full Psi1 event plane angle
+    Double_t  Psi2Full;      // Full Psi2 event plane angle
+    Double_t  PsiBack[2];    // Psi1 and Psi2 from backward side
+    Double_t  PsiFor[2];     // Psi1 and Psi2 from forward side
+    Double_t  r1;            // Resolution for Psi1
+    Double_t  r2;            // Resolution for Psi2
+
+    EventPlane() : EVENTNUMBER(0), RUNNUMBER(0) {}
+
+    ClassDefNV(EventPlane, 2);
+};
+
+// ============================================================================
+// Class storing global event-level quantities for a Lambda event
+// ============================================================================
+class Event {
+public:
+    ULong64_t EVENTNUMBER;
+    UInt_t    RUNNUMBER;
+    Double_t  Psi1Full, Psi2Full;
+    Double_t  Psi1back, Psi2back;
+    Double_t  Psi1for, Psi2for;
+    Double_t  r1, r2;
+    Float_t   PVX, PVY, PVZ;               // Primary vertex position
+    Int_t     nBackTracks, nVeloTracks;    // Event multiplicity info
+    Int_t     nEcalClusters;               // Not used in cuts (but stored)
+
+    Event() : EVENTNUMBER(0), RUNNUMBER(0) {}
+
+    ClassDefNV(Event, 2);
+};
+
+// ============================================================================
+// Lambda candidate reconstructed from proton and pion daughters
+// ============================================================================
+// Output record: the precision of every field is chosen for what the
+// analysis needs (Double32_t/Float16_t comments give the on-disk packing, see
+// TBufferFile::WriteDouble32/WriteFloat16) and fields are ordered by size so
+// that the in-memory layout has no inner padding. Momenta, PV position and
+// DIRA keep full float precision (boost to the rest frame, DIRA cut at
+// 0.9999); angles and chi2 keep 14 and 10 mantissa bits (relative precision
+// 6e-5 and 1e-3).
+class Lambda {
+public:
+    Double32_t MASS;         // Stored as float (0.1 keV at the Lambda mass)
+    Float_t    PT, PX, PY, PZ;
+    Float_t    B_PV_Z, B_PV_X, B_PV_Y; // PV position
+    Float_t    BPVDIRA;      // Direction angle cosine
+    Float16_t  ETA;          //[0,0,14]
+    Float16_t  PHI;          //[0,0,14]
+    Float16_t  BPVIPCHI2;    //[0,0,10] Impact parameter chi2 w.r.t. PV
+    Float16_t  BPVFDCHI2;    //[0,0,10] Flight distance chi2 w.r.t. PV
+    Short_t    ID;           // PDG ID
+
+    Lambda() : ID(0) {}
+
+    ClassDefNV(Lambda, 2);
+};
+
+// ============================================================================
+// Daughter particle (proton or pion) from Lambda decay
+// ============================================================================
+class Daughter {
+public:
+    Double32_t MASS;         // Stored as float
+    Float_t    PT, PX, PY, PZ;
+    Float16_t  ETA;          //[0,0,14]
+    Float16_t  PHI;          //[0,0,14]
+    Float16_t  BPVIPCHI2;    //[0,0,10]
+    Float16_t  GHOSTPROB;    //[0,1,16] Cut at 0.1
+    Short_t    ID;           // PDG ID
+
+    Daughter() : ID(0) {}
+
+    ClassDefNV(Daughter, 2);
+};
+
+#endif // EPDataModel_h
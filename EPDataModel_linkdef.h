@@ -0,0 +1,37 @@
+// ============================================================================
+// EPDataModel_linkdef.h
+//
+// Dictionary selection and schema-evolution rules of the data-model library
+// (EPDataModel.h). ACLiC picks this file up by its name when rootlogon.C
+// compiles EPDataModel.h.
+//
+// Member type changes between class versions (e.g. Lambda and Daughter:
+// Double_t → Double32_t, Float_t → Float16_t, Int_t → Short_t) are converted
+// member by member when reading; only renamed classes and members need a
+// rule here.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifdef __ROOTCLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+#pragma link C++ class QVectorEvent+;
+#pragma link C++ class EventPlane+;
+#pragma link C++ class Event+;
+#pragma link C++ class Lambda+;
+#pragma link C++ class Daughter+;
+
+// Step-1 Q-vector tuples written by EventPlaneAnalysis before the data model
+// was shared store QVectorEvent under the class name "Event" (same members).
+// Step-3 outputs of that time also store an unversioned class "Event", with
+// other members, so the rule is selected by the checksum of the old step-1
+// layout (TClass::GetCheckSum()) rather than by name and version; step-3
+// files keep reading into Event. Checked by TestEPDataModel.C.
+#pragma read sourceClass="Event" targetClass="QVectorEvent" checksum="[0x4a80f566]";
+
+#endif
@@ -0,0 +1,797 @@
+// ============================================================================
+// EPMatchIndex.h
+//
+// Persistent (RUNNUMBER, EVENTNUMBER) -> EP entry index for the Lambda-EP
+// matching step (LHCb Pb+Pb 2024).
+//
+// The index lives in a sidecar file next to the EP file ("<EP file>.idx")
+// holding the keys sorted by (RUNNUMBER, EVENTNUMBER), the matching entry
+// numbers of the EventPlaneTuple, the EP angles and resolution terms of each
+// key (EPPayload, aligned with the keys) and a flat open-addressing hash table
+// over the sorted keys. A match is therefore a hash probe and one array
+// access; the EP file itself is not read by the matching jobs. It is built once per EP file, tied to the
+// EP file's size, modification time and MD5 checksum, and memory-mapped
+// read-only by every matching job, so the setup cost per job is negligible
+// and the pages are shared between processes on the same node.
+//
+// Lookups hash the packed key with a 64-bit mixer and probe the slot table
+// linearly. Each 8-byte slot holds a 32-bit fingerprint of the hash and the
+// position of the key in the sorted arrays, so a probe touches one cache line
+// of slots and, only on a fingerprint hit, one key. The table is kept at most
+// half full, which keeps misses (the common case) to one or two probes.
+//
+// Most candidates have no EP (the match rate is ~20%), so two prefilters in
+// front of the slot table reject most misses without touching it: a bitmap
+// of the run numbers present in the EP file, and a register-blocked Bloom
+// filter over the packed keys (each key sets 4 bits of one 64-bit word, ~12
+// bits per key, ~2% false positives), which costs one cache line and a few
+// shifts per lookup. Both are stored in the sidecar. The run bitmap is used by
+// default; the Bloom filter only pays off when the slot table is much larger
+// than the last-level cache, since in tight lookup loops its extra
+// data-dependent branch costs as much as the probe it saves (see
+// BenchmarkEPMatching.C), so it is enabled with SetPrefilter(kPrefilterBloom).
+//
+// If the sidecar cannot be written (e.g. read-only directory) the index is
+// kept in memory for the lifetime of the object instead.
+//
+// Any index, including one kept in memory (e.g. angles computed from the
+// Q-vectors with a calibration), can also be published once into a POSIX
+// shared-memory segment with the same layout as the sidecar (Publish()).
+// Other processes on the node attach to it read-only (Attach()), so the
+// Λ, K0S and systematic jobs share one copy of the keys and angles, and
+// attaching costs a shm_open and an mmap.
+//
+// Further EP variants (other eta bins, weights or calibrations of the same
+// events) are matched in the same pass through EPVariantSet, which maps every
+// position of the reference index to the position of the same key in each
+// variant's index, so a candidate is looked up only once.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef EPMatchIndex_h
+#define EPMatchIndex_h
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TSystem.h>
+#include <TMD5.h>
+
+#include "EPTrace.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ============================================================================
+// Match key: (RUNNUMBER, EVENTNUMBER), ordered by run first
+// ============================================================================
+struct EPKey {
+    UInt_t    RUNNUMBER;
+    UInt_t    pad;           // Keeps EVENTNUMBER 8-byte aligned in the file
+    ULong64_t EVENTNUMBER;
+};
+
+inline bool operator<(const EPKey& a, const EPKey& b) {
+    if (a.RUNNUMBER != b.RUNNUMBER) return a.RUNNUMBER < b.RUNNUMBER;
+    return a.EVENTNUMBER < b.EVENTNUMBER;
+}
+
+inline bool operator==(const EPKey& a, const EPKey& b) {
+    return a.RUNNUMBER == b.RUNNUMBER && a.EVENTNUMBER == b.EVENTNUMBER;
+}
+
+inline EPKey MakeEPKey(UInt_t run, ULong64_t event) {
+    EPKey key;
+    key.RUNNUMBER = run;
+    key.pad = 0;
+    key.EVENTNUMBER = event;
+    return key;
+}
+
+// ============================================================================
+// EP angles and resolution terms of one event, 64 bytes (one cache line)
+// ============================================================================
+struct EPPayload {
+    Double_t Psi1Full;
+    Double_t Psi2Full;
+    Double_t PsiBack[2];     // Psi1 and Psi2 from backward side
+    Double_t PsiFor[2];      // Psi1 and Psi2 from forward side
+    Double_t r1;
+    Double_t r2;
+};
+
+// 64-bit hash of the packed (run, event) key: the run is spread by a
+// multiplicative constant, folded into the event number and finalized with
+// the MurmurHash3 avalanche step, so nearby keys land in unrelated slots.
+inline ULong64_t HashEPKey(UInt_t run, ULong64_t event) {
+    ULong64_t h = event ^ ((ULong64_t)run * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Checks done before the slot table is probed
+enum EPPrefilter {
+    kPrefilterNone  = 0,   // Probe the slot table directly
+    kPrefilterRuns  = 1,   // Reject runs without EP events (default)
+    kPrefilterBloom = 2    // Run bitmap, then Bloom filter
+};
+
+// ============================================================================
+// Sidecar file (and shared-memory segment) layout: header, sorted keys[nKeys],
+// entries[nKeys], payload[nKeys], slots[nSlots], run bitmap[nRunWords],
+// Bloom words[nBloomWords]
+// ============================================================================
+struct EPIndexHeader {
+    char      magic[8];      // "EPINDEX"
+    UInt_t    version;       // Bumped whenever the layout changes
+    UInt_t    headerSize;
+    Long64_t  nKeys;
+    Long64_t  epFileSize;    // Size of the EP file the index was built from
+    Long64_t  epFileMtime;   // Modification time of the EP file
+    char      epFileMD5[40]; // MD5 checksum of the EP file (hex, 0-terminated)
+    Long64_t  keysOffset;    // Byte offset of the sorted key array
+    Long64_t  entriesOffset; // Byte offset of the entry-number array
+    Long64_t  payloadOffset; // Byte offset of the EPPayload array
+    Long64_t  slotsOffset;   // Byte offset of the hash slot table
+    Long64_t  nSlots;        // Number of hash slots (power of two)
+    Long64_t  runBitsOffset; // Byte offset of the run-presence bitmap
+    Long64_t  nRunWords;     // 64-bit words of the run bitmap (0 = no run filter)
+    Long64_t  bloomOffset;   // Byte offset of the Bloom filter
+    Long64_t  nBloomWords;   // Number of 64-bit Bloom words (power of two)
+    UInt_t    runMin;        // Run number of bit 0 of the run bitmap
+    Int_t     keyOrdered;    // 1 if EP entries are already in key order
+};
+
+// Bloom filter bits of a key hash within its word: four 6-bit fields of the low hash bits
+inline ULong64_t EPBloomMask(ULong64_t h) {
+    return (1ULL << (h & 63)) | (1ULL << ((h >> 6) & 63)) | (1ULL << ((h >> 12) & 63)) | (1ULL << ((h >> 18) & 63));
+}
+
+class EPMatchIndex {
+public:
+    static const UInt_t kVersion = 5;
+    static const Long64_t kMaxRunBits = 1LL << 24;   // Run range covered by the run bitmap
+    static const int kBloomBitsPerKey = 12;
+
+    EPMatchIndex() : fMap(nullptr), fMapSize(0), fKeys(nullptr), fEntries(nullptr), fPayload(nullptr),
+                     fSlots(nullptr), fSlotMask(0), fRunBits(nullptr), fNRunWords(0), fRunMin(0),
+                     fBloom(nullptr), fBloomMask(0), fPrefilter(kPrefilterRuns), fKeyOrdered(false), fShared(false),
+                     fN(0) {}
+    ~EPMatchIndex() { Unmap(); }
+
+    // Sidecar file used for a given EP file
+    static std::string SidecarName(const std::string& epFileName) { return epFileName + ".idx"; }
+
+    // Shared-memory segment name for an EP file: "/epindex_<hash>" of the
+    // absolute path. With a weights file (angles computed from Q-vectors) the
+    // path, size and modification time of the weights file enter the hash, so
+    // a new calibration gets a new segment.
+    static std::string SharedMemoryName(const std::string& epFileName, const std::string& weightsFile = "") {
+        std::string id = AbsolutePath(epFileName);
+        FileStat_t weightsStat;
+        if (!weightsFile.empty()) {
+            id += "|" + AbsolutePath(weightsFile);
+            if (gSystem->GetPathInfo(weightsFile.c_str(), weightsStat) == 0)
+                id += Form("|%lld|%ld", (Long64_t)weightsStat.fSize, (Long_t)weightsStat.fMtime);
+        }
+        ULong64_t h = 0xCBF29CE484222325ULL;   // FNV-1a
+        for (char c : id) h = (h ^ (unsigned char)c) * 0x100000001B3ULL;
+        return Form("/epindex_%016llx", (unsigned long long)h);
+    }
+
+    // Map the sidecar of epFileName, (re)building it from the EP file if it
+    // is missing or was built from a different EP file. Returns false on error.
+    bool Open(const std::string& epFileName) {
+        EPTraceScope trace("open EP index", "io", epFileName);
+        Unmap();
+        std::string idxName = SidecarName(epFileName);
+
+        FileStat_t epStat;
+        if (gSystem->GetPathInfo(epFileName.c_str(), epStat) != 0) {
+            std::cerr << "WARNING: Cannot stat EP file " << epFileName
+                      << ", keeping the EP index in memory." << std::endl;
+            return BuildInMemory(epFileName);
+        }
+
+        if (Map(idxName) && IsValidFor(epFileName, epStat)) return true;
+        Unmap();
+
+        std::cout << "Building EP index sidecar " << idxName << std::endl;
+        std::vector<std::pair<EPKey, Long64_t> > pairs;
+        std::vector<EPPayload> payload;
+        if (!ReadEPFile(epFileName, pairs, payload)) return false;
+        Build(pairs, &payload);
+
+        TMD5* md5 = TMD5::FileChecksum(epFileName.c_str());
+        std::string checksum = md5 ? md5->AsString() : "";
+        delete md5;
+
+        if (Write(idxName, epStat, checksum)) {
+            EPMatchIndex mapped;
+            if (mapped.Map(idxName)) {
+                Swap(mapped);
+                return true;
+            }
+        }
+        std::cerr << "WARNING: Cannot write EP index sidecar " << idxName
+                  << ", keeping the EP index in memory." << std::endl;
+        return true;
+    }
+
+    // Build the index in memory from (key, EP entry) pairs and, optionally,
+    // the payload of every EP entry (indexed by entry number). The pairs are
+    // sorted in place; for duplicated keys the last EP entry wins.
+    void Build(std::vector<std::pair<EPKey, Long64_t> >& pairs, const std::vector<EPPayload>* payload = nullptr) {
+        EPTraceScope trace("build EP index", "step3");
+        Unmap();
+        std::sort(pairs.begin(), pairs.end(),
+                  [](const std::pair<EPKey, Long64_t>& a, const std::pair<EPKey, Long64_t>& b) {
+                      if (a.first == b.first) return a.second < b.second;
+                      return a.first < b.first;
+                  });
+
+        fOwnedKeys.clear();
+        fOwnedEntries.clear();
+        fOwnedKeys.reserve(pairs.size());
+        fOwnedEntries.reserve(pairs.size());
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            if (!fOwnedKeys.empty() && fOwnedKeys.back() == pairs[i].first) {
+                std::cerr << "WARNING: Duplicate EP key for RUN " << pairs[i].first.RUNNUMBER
+                          << " EVENT " << pairs[i].first.EVENTNUMBER << std::endl;
+                fOwnedEntries.back() = pairs[i].second;
+                continue;
+            }
+            fOwnedKeys.push_back(pairs[i].first);
+            fOwnedEntries.push_back(pairs[i].second);
+        }
+        fOwnedPayload.clear();
+        if (payload) {
+            fOwnedPayload.reserve(fOwnedEntries.size());
+            for (Long64_t entry : fOwnedEntries) fOwnedPayload.push_back((*payload)[entry]);
+        }
+
+        // Slot table at most half full
+        Long64_t nSlots = 16;
+        while (nSlots < 2 * (Long64_t)fOwnedKeys.size()) nSlots <<= 1;
+        fOwnedSlots.assign(nSlots, 0);
+        for (size_t pos = 0; pos < fOwnedKeys.size(); ++pos) {
+            ULong64_t h = HashEPKey(fOwnedKeys[pos].RUNNUMBER, fOwnedKeys[pos].EVENTNUMBER);
+            ULong64_t slot = h & (nSlots - 1);
+            while (fOwnedSlots[slot] != 0) slot = (slot + 1) & (nSlots - 1);
+            fOwnedSlots[slot] = (h & 0xFFFFFFFF00000000ULL) | (ULong64_t)(pos + 1);
+        }
+
+        // Run bitmap over [first run, last run], unless the range is unreasonably wide
+        fOwnedRunBits.clear();
+        fRunMin = fOwnedKeys.empty() ? 0 : fOwnedKeys.front().RUNNUMBER;
+        Long64_t runRange = fOwnedKeys.empty() ? 0 : (Long64_t)fOwnedKeys.back().RUNNUMBER - fRunMin + 1;
+        if (runRange <= kMaxRunBits) {
+            fOwnedRunBits.assign((runRange + 63) / 64, 0);
+            for (const EPKey& key : fOwnedKeys) {
+                UInt_t bit = key.RUNNUMBER - fRunMin;
+                fOwnedRunBits[bit >> 6] |= 1ULL << (bit & 63);
+            }
+        }
+
+        // Bloom filter words, indexed by the high hash bits
+        Long64_t nBloomWords = 1;
+        while (nBloomWords * 64 < kBloomBitsPerKey * (Long64_t)fOwnedKeys.size()) nBloomWords <<= 1;
+        fOwnedBloom.assign(nBloomWords, 0);
+        for (const EPKey& key : fOwnedKeys) {
+            ULong64_t h = HashEPKey(key.RUNNUMBER, key.EVENTNUMBER);
+            fOwnedBloom[(h >> 32) & (nBloomWords - 1)] |= EPBloomMask(h);
+        }
+
+        fKeyOrdered = std::is_sorted(fOwnedEntries.begin(), fOwnedEntries.end());
+        fN = fOwnedKeys.size();
+        fKeys = fOwnedKeys.data();
+        fEntries = fOwnedEntries.data();
+        fPayload = payload ? fOwnedPayload.data() : nullptr;
+        fSlots = fOwnedSlots.data();
+        fSlotMask = nSlots - 1;
+        fRunBits = fOwnedRunBits.data();
+        fNRunWords = fOwnedRunBits.size();
+        fBloom = fOwnedBloom.data();
+        fBloomMask = nBloomWords - 1;
+    }
+
+    // EP entry number for (run, event), or -1 if the event has no EP
+    Long64_t Find(UInt_t run, ULong64_t event) const {
+        Long64_t pos = FindPosition(run, event);
+        return pos < 0 ? -1 : fEntries[pos];
+    }
+
+    // Position of (run, event) in the sorted arrays, or -1 if the event has no EP
+    Long64_t FindPosition(UInt_t run, ULong64_t event) const {
+        if (!fSlots) return -1;
+        if (fPrefilter >= kPrefilterRuns && fNRunWords > 0) {
+            ULong64_t bit = (ULong64_t)(UInt_t)(run - fRunMin);   // Runs below fRunMin wrap around
+            if (bit >= (ULong64_t)fNRunWords * 64 || !(fRunBits[bit >> 6] & (1ULL << (bit & 63)))) return -1;
+        }
+        ULong64_t h = HashEPKey(run, event);
+        if (fPrefilter >= kPrefilterBloom && fBloom) {
+            ULong64_t bits = EPBloomMask(h);
+            if ((fBloom[(h >> 32) & fBloomMask] & bits) != bits) return -1;
+        }
+        ULong64_t tag = h & 0xFFFFFFFF00000000ULL;
+        for (ULong64_t slot = h & fSlotMask; ; slot = (slot + 1) & fSlotMask) {
+            ULong64_t s = fSlots[slot];
+            if (s == 0) return -1;
+            if ((s & 0xFFFFFFFF00000000ULL) != tag) continue;
+            const EPKey& key = fKeys[(s & 0xFFFFFFFFULL) - 1];
+            if (key.EVENTNUMBER == event && key.RUNNUMBER == run) return (s & 0xFFFFFFFFULL) - 1;
+        }
+    }
+
+    // Copy the index, with its EP angles, into the shared-memory segment
+    // shmName, tied to epFileName like the sidecar. An existing segment of that
+    // name is replaced; processes attached to it keep their mapping. The
+    // header magic is written last, so clients never accept a partial image.
+    // The segment lives until Unpublish() or reboot.
+    bool Publish(const std::string& shmName, const std::string& epFileName) const {
+        if (!HasPayload()) {
+            std::cerr << "EP index holds no EP angles, not publishing " << shmName << std::endl;
+            return false;
+        }
+        FileStat_t epStat;
+        if (gSystem->GetPathInfo(epFileName.c_str(), epStat) != 0) {
+            std::cerr << "Cannot stat EP file " << epFileName << std::endl;
+            return false;
+        }
+        std::string checksum;
+        if (fMap) {
+            checksum = ((const EPIndexHeader*)fMap)->epFileMD5;
+        } else {
+            TMD5* md5 = TMD5::FileChecksum(epFileName.c_str());
+            checksum = md5 ? md5->AsString() : "";
+            delete md5;
+        }
+        EPIndexHeader header = MakeHeader(epStat, checksum);
+        Long64_t size = header.bloomOffset + header.nBloomWords * (Long64_t)sizeof(ULong64_t);
+
+        shm_unlink(shmName.c_str());
+        int fd = shm_open(shmName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            std::cerr << "Cannot create shared memory segment " << shmName << std::endl;
+            return false;
+        }
+        // Size the segment (the only way on macOS); on Linux also reserve the
+        // pages now, so that a full /dev/shm fails here and not with SIGBUS
+        // while copying
+        bool sized = ftruncate(fd, size) == 0;
+#ifdef __linux__
+        sized = sized && posix_fallocate(fd, 0, size) == 0;
+#endif
+        if (!sized) {
+            std::cerr << "Cannot allocate " << size << " bytes of shared memory for " << shmName << std::endl;
+            close(fd);
+            shm_unlink(shmName.c_str());
+            return false;
+        }
+        void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            shm_unlink(shmName.c_str());
+            return false;
+        }
+        char* image = (char*)map;
+        std::memcpy(image + header.keysOffset, fKeys, fN * sizeof(EPKey));
+        std::memcpy(image + header.entriesOffset, fEntries, fN * sizeof(Long64_t));
+        std::memcpy(image + header.payloadOffset, fPayload, fN * sizeof(EPPayload));
+        std::memcpy(image + header.slotsOffset, fSlots, header.nSlots * sizeof(ULong64_t));
+        std::memcpy(image + header.runBitsOffset, fRunBits, header.nRunWords * sizeof(ULong64_t));
+        std::memcpy(image + header.bloomOffset, fBloom, header.nBloomWords * sizeof(ULong64_t));
+        char magic[sizeof(header.magic)];
+        std::memcpy(magic, header.magic, sizeof(magic));
+        std::memset(header.magic, 0, sizeof(header.magic));
+        std::memcpy(image, &header, sizeof(header));
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(image, magic, sizeof(magic));
+        munmap(map, size);
+        return true;
+    }
+
+    // Attach read-only to a segment written by Publish(). False if it does not
+    // exist, is still being written, or was built from a different EP file.
+    bool Attach(const std::string& shmName, const std::string& epFileName) {
+        Unmap();
+        int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        if (!MapDescriptor(fd)) return false;
+        FileStat_t epStat;
+        if (gSystem->GetPathInfo(epFileName.c_str(), epStat) != 0 || !IsValidFor(epFileName, epStat)) {
+            Unmap();
+            return false;
+        }
+        fShared = true;
+        return true;
+    }
+
+    // Remove a published segment; attached processes keep their mapping
+    static bool Unpublish(const std::string& shmName) { return shm_unlink(shmName.c_str()) == 0; }
+
+    Long64_t GetN() const { return fN; }
+    bool IsMapped() const { return fMap != nullptr; }
+    bool IsShared() const { return fShared; }   // Attached to a shared-memory segment
+
+    // Select the checks in front of the slot table (EPPrefilter)
+    void SetPrefilter(int prefilter) { fPrefilter = prefilter; }
+    int GetPrefilter() const { return fPrefilter; }
+
+    // Sorted access, for merge joins: key and EP entry at position pos
+    const EPKey& GetKey(Long64_t pos) const { return fKeys[pos]; }
+    Long64_t GetEntryNumber(Long64_t pos) const { return fEntries[pos]; }
+
+    // EP angles and resolution terms at position pos (only if HasPayload())
+    const EPPayload& GetPayload(Long64_t pos) const { return fPayload[pos]; }
+    bool HasPayload() const { return fPayload != nullptr; }
+
+    // True if the EP entry numbers increase with the key, i.e. the EP file
+    // itself is sorted by (RUNNUMBER, EVENTNUMBER) (see SortEventPlaneFile)
+    bool IsKeyOrdered() const { return fKeyOrdered; }
+
+    // Bytes used by the keys, entry numbers, payload, slot table and prefilters
+    Long64_t GetMemoryBytes() const {
+        return fN * (Long64_t)(sizeof(EPKey) + sizeof(Long64_t) + (fPayload ? sizeof(EPPayload) : 0)) +
+               (Long64_t)(fSlotMask + 1) * sizeof(ULong64_t) + fNRunWords * (Long64_t)sizeof(ULong64_t) +
+               (fBloom ? (Long64_t)(fBloomMask + 1) * sizeof(ULong64_t) : 0);
+    }
+
+private:
+    // Read the key and payload leaves of the split "eventplane" branch in one
+    // sequential pass; payload is indexed by EP entry number
+    static bool ReadEPFile(const std::string& epFileName, std::vector<std::pair<EPKey, Long64_t> >& pairs,
+                           std::vector<EPPayload>& payload) {
+        TFile* EpFile = TFile::Open(epFileName.c_str());
+        if (!EpFile || EpFile->IsZombie()) {
+            std::cerr << "Could not open EP file: " << epFileName << std::endl;
+            return false;
+        }
+        TTree* EPtree = (TTree*)EpFile->Get("EventPlaneTuple");
+        TBranch* brRun = EPtree ? EPtree->GetBranch("RUNNUMBER") : nullptr;
+        TBranch* brEvent = EPtree ? EPtree->GetBranch("EVENTNUMBER") : nullptr;
+        if (!brRun || !brEvent) {
+            std::cerr << "Cannot find RUNNUMBER/EVENTNUMBER branches in 'EventPlaneTuple'." << std::endl;
+            delete EpFile;
+            return false;
+        }
+
+        UInt_t run = 0;
+        ULong64_t event = 0;
+        EPPayload values;
+        // Leaves of the split object branch are bound to plain variables: in
+        // MakeClass mode ROOT takes the addresses as they are, otherwise it
+        // treats them as object addresses and adds the member offsets
+        EPtree->SetMakeClass(1);
+        EPtree->SetBranchAddress("RUNNUMBER", &run);
+        EPtree->SetBranchAddress("EVENTNUMBER", &event);
+
+        EPtree->SetCacheSize(64 * 1024 * 1024);   // Read the baskets in bulk
+        std::vector<TBranch*> leaves;
+        leaves.push_back(brRun);
+        leaves.push_back(brEvent);
+        const char* payloadNames[] = {"Psi1Full", "Psi2Full", "PsiBack[2]", "PsiFor[2]", "r1", "r2"};
+        void* payloadAddresses[] = {&values.Psi1Full, &values.Psi2Full, values.PsiBack, values.PsiFor,
+                                    &values.r1, &values.r2};
+        for (int k = 0; k < 6; ++k) {
+            TBranch* branch = EPtree->GetBranch(payloadNames[k]);
+            if (!branch) {
+                std::cerr << "Cannot find branch '" << payloadNames[k] << "' in 'EventPlaneTuple'." << std::endl;
+                delete EpFile;
+                return false;
+            }
+            EPtree->SetBranchAddress(payloadNames[k], payloadAddresses[k]);
+            leaves.push_back(branch);
+        }
+        for (auto branch : leaves) EPtree->AddBranchToCache(branch);
+        EPtree->StopCacheLearningPhase();
+
+        Long64_t nEP = EPtree->GetEntries();
+        pairs.clear();
+        pairs.reserve(nEP);
+        payload.resize(nEP);
+        for (Long64_t iEP = 0; iEP < nEP; ++iEP) {
+            for (auto branch : leaves) branch->GetEntry(iEP);
+            pairs.push_back(std::make_pair(MakeEPKey(run, event), iEP));
+            payload[iEP] = values;
+        }
+        delete EpFile;
+        return true;
+    }
+
+    // Check that the mapped sidecar was built from this EP file. Size and
+    // mtime are compared first; the MD5 is only recomputed if the mtime moved
+    // (e.g. the EP file was copied), so the common case does not touch the EP file.
+    bool IsValidFor(const std::string& epFileName, const FileStat_t& epStat) const {
+        const EPIndexHeader* header = (const EPIndexHeader*)fMap;
+        if (header->epFileSize != epStat.fSize) return false;
+        if (header->epFileMtime == (Long64_t)epStat.fMtime) return true;
+
+        TMD5* md5 = TMD5::FileChecksum(epFileName.c_str());
+        bool same = md5 && std::strcmp(md5->AsString(), header->epFileMD5) == 0;
+        delete md5;
+        return same;
+    }
+
+    // Write the sidecar to a temporary file and move it into place, so that
+    // concurrent jobs never map a half-written index.
+    bool Write(const std::string& idxName, const FileStat_t& epStat, const std::string& checksum) const {
+        EPIndexHeader header = MakeHeader(epStat, checksum);
+        std::string tmpName = Form("%s.tmp%d", idxName.c_str(), gSystem->GetPid());
+        std::ofstream out(tmpName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)fKeys, fN * sizeof(EPKey));
+        out.write((const char*)fEntries, fN * sizeof(Long64_t));
+        out.write((const char*)fPayload, fN * sizeof(EPPayload));
+        out.write((const char*)fSlots, header.nSlots * sizeof(ULong64_t));
+        out.write((const char*)fRunBits, header.nRunWords * sizeof(ULong64_t));
+        out.write((const char*)fBloom, header.nBloomWords * sizeof(ULong64_t));
+        out.close();
+        if (!out) {
+            gSystem->Unlink(tmpName.c_str());
+            return false;
+        }
+        return gSystem->Rename(tmpName.c_str(), idxName.c_str()) == 0;
+    }
+
+    // Header describing the current index, built from the EP file epStat
+    EPIndexHeader MakeHeader(const FileStat_t& epStat, const std::string& checksum) const {
+        EPIndexHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::strncpy(header.magic, "EPINDEX", sizeof(header.magic));
+        header.version       = kVersion;
+        header.headerSize    = sizeof(EPIndexHeader);
+        header.nKeys         = fN;
+        header.epFileSize    = epStat.fSize;
+        header.epFileMtime   = epStat.fMtime;
+        std::strncpy(header.epFileMD5, checksum.c_str(), sizeof(header.epFileMD5) - 1);
+        header.keysOffset    = sizeof(EPIndexHeader);
+        header.entriesOffset = header.keysOffset + header.nKeys * sizeof(EPKey);
+        header.payloadOffset = header.entriesOffset + header.nKeys * sizeof(Long64_t);
+        header.slotsOffset   = header.payloadOffset + header.nKeys * sizeof(EPPayload);
+        header.nSlots        = fSlotMask + 1;
+        header.runBitsOffset = header.slotsOffset + header.nSlots * sizeof(ULong64_t);
+        header.nRunWords     = fNRunWords;
+        header.bloomOffset   = header.runBitsOffset + header.nRunWords * sizeof(ULong64_t);
+        header.nBloomWords   = fBloomMask + 1;
+        header.runMin        = fRunMin;
+        header.keyOrdered    = fKeyOrdered;
+        return header;
+    }
+
+    // Map an existing sidecar read-only; false if missing or of another version
+    bool Map(const std::string& idxName) {
+        int fd = open(idxName.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        return MapDescriptor(fd);
+    }
+
+    // Map an open sidecar or shared-memory segment read-only and close fd
+    bool MapDescriptor(int fd) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(EPIndexHeader)) {
+            close(fd);
+            return false;
+        }
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return false;
+
+        fMap = map;
+        fMapSize = st.st_size;
+        const EPIndexHeader* header = (const EPIndexHeader*)fMap;
+        if (std::strncmp(header->magic, "EPINDEX", sizeof(header->magic)) != 0) {
+            Unmap();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);   // Pairs with Publish()
+        Long64_t expected = header->bloomOffset + header->nBloomWords * (Long64_t)sizeof(ULong64_t);
+        if (header->version != kVersion || header->headerSize != sizeof(EPIndexHeader) ||
+            header->slotsOffset != header->payloadOffset + header->nKeys * (Long64_t)sizeof(EPPayload) ||
+            header->runBitsOffset != header->slotsOffset + header->nSlots * (Long64_t)sizeof(ULong64_t) ||
+            header->bloomOffset != header->runBitsOffset + header->nRunWords * (Long64_t)sizeof(ULong64_t) ||
+            (Long64_t)fMapSize != expected) {
+            Unmap();
+            return false;
+        }
+        fN = header->nKeys;
+        fKeys = (const EPKey*)((const char*)fMap + header->keysOffset);
+        fEntries = (const Long64_t*)((const char*)fMap + header->entriesOffset);
+        fPayload = (const EPPayload*)((const char*)fMap + header->payloadOffset);
+        fSlots = (const ULong64_t*)((const char*)fMap + header->slotsOffset);
+        fSlotMask = header->nSlots - 1;
+        fRunBits = (const ULong64_t*)((const char*)fMap + header->runBitsOffset);
+        fNRunWords = header->nRunWords;
+        fRunMin = header->runMin;
+        fBloom = (const ULong64_t*)((const char*)fMap + header->bloomOffset);
+        fBloomMask = header->nBloomWords - 1;
+        fKeyOrdered = header->keyOrdered;
+        return true;
+    }
+
+    void Unmap() {
+        if (fMap) munmap(fMap, fMapSize);
+        fMap = nullptr;
+        fMapSize = 0;
+        fKeys = nullptr;
+        fEntries = nullptr;
+        fPayload = nullptr;
+        fSlots = nullptr;
+        fSlotMask = 0;
+        fRunBits = nullptr;
+        fNRunWords = 0;
+        fRunMin = 0;
+        fBloom = nullptr;
+        fBloomMask = 0;
+        fKeyOrdered = false;
+        fShared = false;
+        fN = 0;
+        fOwnedKeys.clear();
+        fOwnedEntries.clear();
+        fOwnedPayload.clear();
+        fOwnedSlots.clear();
+        fOwnedRunBits.clear();
+        fOwnedBloom.clear();
+    }
+
+    static std::string AbsolutePath(const std::string& fileName) {
+        TString path(fileName.c_str());
+        gSystem->ExpandPathName(path);
+        if (!gSystem->IsAbsoluteFileName(path.Data())) path = Form("%s/%s", gSystem->WorkingDirectory(), path.Data());
+        return path.Data();
+    }
+
+    bool BuildInMemory(const std::string& epFileName) {
+        std::vector<std::pair<EPKey, Long64_t> > pairs;
+        std::vector<EPPayload> payload;
+        if (!ReadEPFile(epFileName, pairs, payload)) return false;
+        Build(pairs, &payload);
+        return true;
+    }
+
+    // Exchange contents with another index (vector swaps keep the views valid)
+    void Swap(EPMatchIndex& other) {
+        std::swap(fMap, other.fMap);
+        std::swap(fMapSize, other.fMapSize);
+        std::swap(fKeys, other.fKeys);
+        std::swap(fEntries, other.fEntries);
+        std::swap(fPayload, other.fPayload);
+        std::swap(fSlots, other.fSlots);
+        std::swap(fSlotMask, other.fSlotMask);
+        std::swap(fRunBits, other.fRunBits);
+        std::swap(fNRunWords, other.fNRunWords);
+        std::swap(fRunMin, other.fRunMin);
+        std::swap(fBloom, other.fBloom);
+        std::swap(fBloomMask, other.fBloomMask);
+        std::swap(fKeyOrdered, other.fKeyOrdered);
+        std::swap(fShared, other.fShared);
+        std::swap(fN, other.fN);
+        fOwnedKeys.swap(other.fOwnedKeys);
+        fOwnedEntries.swap(other.fOwnedEntries);
+        fOwnedPayload.swap(other.fOwnedPayload);
+        fOwnedSlots.swap(other.fOwnedSlots);
+        fOwnedRunBits.swap(other.fOwnedRunBits);
+        fOwnedBloom.swap(other.fOwnedBloom);
+    }
+
+    void*                 fMap;          // Mapped sidecar or shared segment (nullptr if in memory)
+    size_t                fMapSize;
+    const EPKey*          fKeys;         // Sorted keys
+    const Long64_t*       fEntries;      // EP entry number per key
+    const EPPayload*      fPayload;      // EP angles per key (nullptr if not loaded)
+    const ULong64_t*      fSlots;        // Hash slots: fingerprint << 32 | (position + 1), 0 = empty
+    ULong64_t             fSlotMask;     // Number of slots - 1
+    const ULong64_t*      fRunBits;      // Bit (run - fRunMin) set if the run has EP events
+    Long64_t              fNRunWords;    // 0 = no run filter
+    UInt_t                fRunMin;
+    const ULong64_t*      fBloom;        // Bloom filter words
+    ULong64_t             fBloomMask;    // Number of Bloom words - 1
+    int                   fPrefilter;    // EPPrefilter
+    bool                  fKeyOrdered;   // EP entries increase with the key
+    bool                  fShared;       // fMap is a shared-memory segment
+    Long64_t              fN;
+    std::vector<EPKey>    fOwnedKeys;    // In-memory storage (no sidecar)
+    std::vector<Long64_t> fOwnedEntries;
+    std::vector<EPPayload> fOwnedPayload;
+    std::vector<ULong64_t> fOwnedSlots;
+    std::vector<ULong64_t> fOwnedRunBits;
+    std::vector<ULong64_t> fOwnedBloom;
+};
+
+// ============================================================================
+// EPVariantSet
+// ============================================================================
+// EP variants matched together with a reference index. Each variant has its
+// own EPMatchIndex; Align() walks the sorted keys of the reference and of
+// every variant once and stores, for each reference position, the positions
+// of the same key in all variants next to each other. A candidate found at
+// reference position pos then reads the angles of all variants without any
+// further hash probe.
+class EPVariantSet {
+public:
+    // Add a variant; names are used in branch and directory names and must be
+    // unique. Returns false if the name is taken or the index has no EP angles.
+    bool Add(const std::string& name, std::unique_ptr<EPMatchIndex> index) {
+        if (std::find(fNames.begin(), fNames.end(), name) != fNames.end()) {
+            std::cerr << "EP variant '" << name << "' given twice." << std::endl;
+            return false;
+        }
+        if (!index->HasPayload()) {
+            std::cerr << "EP index of variant '" << name << "' holds no EP angles." << std::endl;
+            return false;
+        }
+        fNames.push_back(name);
+        fIndices.push_back(std::move(index));
+        fPositions.clear();
+        return true;
+    }
+
+    // Map the positions of reference to the variants (merge over sorted keys)
+    void Align(const EPMatchIndex& reference) {
+        const size_t nVariants = fNames.size();
+        const Long64_t nReference = reference.GetN();
+        fPositions.assign(nReference * nVariants, -1);
+        fNMatched.assign(nVariants, 0);
+        for (size_t v = 0; v < nVariants; ++v) {
+            const EPMatchIndex& variant = *fIndices[v];
+            Long64_t vPos = 0, nVariant = variant.GetN();
+            for (Long64_t pos = 0; pos < nReference; ++pos) {
+                const EPKey& key = reference.GetKey(pos);
+                while (vPos < nVariant && variant.GetKey(vPos) < key) ++vPos;
+                if (vPos == nVariant) break;
+                if (!(variant.GetKey(vPos) == key)) continue;
+                fPositions[pos * nVariants + v] = vPos;
+                fNMatched[v]++;
+            }
+        }
+    }
+
+    int GetN() const { return (int)fNames.size(); }
+    const std::string& GetName(int v) const { return fNames[v]; }
+    const EPMatchIndex& GetIndex(int v) const { return *fIndices[v]; }
+
+    // Reference keys also present in variant v (after Align())
+    Long64_t GetNMatched(int v) const { return fNMatched[v]; }
+
+    // Position in variant v of the key at reference position pos, -1 if absent
+    Long64_t GetPosition(Long64_t pos, int v) const { return fPositions[pos * fNames.size() + v]; }
+
+    // EP angles of variant v for reference position pos, nullptr if absent
+    const EPPayload* GetPayload(Long64_t pos, int v) const {
+        Long64_t vPos = GetPosition(pos, v);
+        return vPos < 0 ? nullptr : &fIndices[v]->GetPayload(vPos);
+    }
+
+    // Entry number in the EP file of variant v, -1 if absent
+    Long64_t GetEntryNumber(Long64_t pos, int v) const {
+        Long64_t vPos = GetPosition(pos, v);
+        return vPos < 0 ? -1 : fIndices[v]->GetEntryNumber(vPos);
+    }
+
+private:
+    std::vector<std::string>                   fNames;
+    std::vector<std::unique_ptr<EPMatchIndex> > fIndices;
+    std::vector<Long64_t>                      fPositions;   // [reference position][variant]
+    std::vector<Long64_t>                      fNMatched;
+};
+
+#endif // EPMatchIndex_h
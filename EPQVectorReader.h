@@ -0,0 +1,291 @@
+// ============================================================================
+// EPQVectorReader.h
+//
+// Step-1 Q-vector calculation (EventPlaneAnalysis) in reusable form: reads
+// the EventTuplePV tree of one Analysis Production file, applies the event-
+// and track-level cuts and returns the Q-vectors (1st and 2nd harmonics,
+// backward side and 3 + 1 forward eta bins, with and without eta weight) of
+// every selected event as a QVectorEvent (EPDataModel.h).
+//
+// EventPlaneAnalysis writes these events to the Q-vector tuple; the
+// in-process pipeline (GlobalPolarizationPipeline.C) streams them directly
+// into the EP calibration instead.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef EPQVectorReader_h
+#define EPQVectorReader_h
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TDirectory.h>
+#include <TMath.h>
+#include <TSystemDirectory.h>
+#include <TSystemFile.h>
+#include <TList.h>
+#include <TString.h>
+#include <TRegexp.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "EPDataModel.h"
+#include "EPTrace.h"
+
+// ==========================
+// GetFilteredRootFiles
+// ==========================
+// Scans a directory and selects ROOT files matching a specific regex pattern.
+// Only files of the form: 00274156_00000###_1.tuple_pbpb2024.root are accepted.
+inline std::vector<std::string> GetFilteredRootFiles(const std::string& dirPath) {
+    std::vector<std::string> fileNames;
+
+    TSystemDirectory dir("dir", dirPath.c_str());
+    TList* files = dir.GetListOfFiles();
+    if (!files) {
+        std::cerr << "Could not open or read directory: " << dirPath << std::endl;
+        return fileNames;
+    }
+
+    TIter next(files);
+    TSystemFile* file;
+
+    // Regex pattern for PbPb 2024 AP file naming scheme
+    TRegexp pattern("^00274156_00000[0-4][0-9][0-9]_1\\.tuple_pbpb2024\\.root$");
+    while ((file = (TSystemFile*)next())) {
+        TString fname = file->GetName();
+        if (!file->IsDirectory() && fname.EndsWith(".root") && fname.Contains(pattern)) {
+            std::string fullpath = dirPath + "/" + fname.Data();
+            std::cout << "Adding file: " << fullpath << std::endl;
+            fileNames.push_back(fullpath);
+        }
+    }
+
+    delete files;
+    return fileNames;
+}
+
+// ============================================================================
+// EPQVectorReader
+// ============================================================================
+// One reader per AP file (and thread): Open(), then Next() until it returns false.
+class EPQVectorReader {
+public:
+    static const int kMaxTracks = 10000;   // Max number of tracks per event
+
+    EPQVectorReader() : fFile(nullptr), fTree(nullptr), fEntry(0), fNEntries(0),
+                        PVX(kMaxTracks), PVY(kMaxTracks), PVZ(kMaxTracks),
+                        VELOTRACK_BIPCHI2(kMaxTracks), VELOTRACK_ETA(kMaxTracks),
+                        VELOTRACK_ISBACKWARD(kMaxTracks), VELOTRACK_NVPHITS(kMaxTracks),
+                        VELOTRACK_PHI(kMaxTracks), VELOTRACK_PX(kMaxTracks), VELOTRACK_PY(kMaxTracks),
+                        VELOTRACK_PZ(kMaxTracks), VELOTRACK_RHO(kMaxTracks) {}
+    ~EPQVectorReader() { Close(); }
+
+    // Open an AP file and connect the EventTuplePV branches. Returns false on error.
+    bool Open(const std::string& fileName) {
+        EPTraceScope trace("open AP file", "io", fileName);
+        Close();
+        fFile = TFile::Open(fileName.c_str());
+        if (!fFile || fFile->IsZombie()) {
+            std::cerr << "Could not open file: " << fileName << std::endl;
+            Close();
+            return false;
+        }
+
+        // Navigate to EventTuplePV directory
+        TDirectory* dir = (TDirectory*)fFile->Get("EventTuplePV");
+        if (!dir) {
+            std::cerr << "Directory 'EventTuplePV' not found in file: " << fileName << std::endl;
+            Close();
+            return false;
+        }
+
+        // Retrieve tree from directory
+        fTree = (TTree*)dir->Get("EventTuplePV");
+        if (!fTree) {
+            std::cerr << "Tree not found in directory 'EventTuplePV' in file: " << fileName << std::endl;
+            Close();
+            return false;
+        }
+
+        fTree->SetBranchAddress("GPSTIME", &GPSTIME);
+        fTree->SetBranchAddress("EVENTNUMBER", &EVENTNUMBER);
+        fTree->SetBranchAddress("PVX", PVX.data());
+        fTree->SetBranchAddress("PVY", PVY.data());
+        fTree->SetBranchAddress("PVZ", PVZ.data());
+        fTree->SetBranchAddress("RUNNUMBER", &RUNNUMBER);
+        fTree->SetBranchAddress("VELOTRACK_BIPCHI2", VELOTRACK_BIPCHI2.data());
+        fTree->SetBranchAddress("VELOTRACK_ETA", VELOTRACK_ETA.data());
+        fTree->SetBranchAddress("VELOTRACK_ISBACKWARD", VELOTRACK_ISBACKWARD.data());
+        fTree->SetBranchAddress("VELOTRACK_NVPHITS", VELOTRACK_NVPHITS.data());
+        fTree->SetBranchAddress("VELOTRACK_PHI", VELOTRACK_PHI.data());
+        fTree->SetBranchAddress("VELOTRACK_PX", VELOTRACK_PX.data());
+        fTree->SetBranchAddress("VELOTRACK_PY", VELOTRACK_PY.data());
+        fTree->SetBranchAddress("VELOTRACK_PZ", VELOTRACK_PZ.data());
+        fTree->SetBranchAddress("VELOTRACK_RHO", VELOTRACK_RHO.data());
+        fTree->SetBranchAddress("nBackTracks", &nBackTracks);
+        fTree->SetBranchAddress("nPVs", &nPVs);
+        fTree->SetBranchAddress("nVeloClusters", &nVeloClusters);
+        fTree->SetBranchAddress("nVeloTracks", &nVeloTracks);
+        fTree->SetBranchAddress("nEcalClusters", &nEcalClusters);
+        fTree->SetBranchAddress("ECalETot", &ECalETot);
+        fTree->SetBranchAddress("nLongTracks", &nLongTracks);
+        fTree->SetBranchAddress("nVPClusters", &nVPClusters);
+
+        fEntry = 0;
+        fNEntries = fTree->GetEntries();
+        return true;
+    }
+
+    // Fill out with the next event passing the selection; false at the end of the file
+    bool Next(QVectorEvent& out) {
+        while (fTree && fEntry < fNEntries) {
+            fTree->GetEntry(fEntry++);
+            if (Compute(out)) return true;
+        }
+        return false;
+    }
+
+    Long64_t GetEntries() const { return fNEntries; }
+
+    void Close() {
+        delete fFile;   // Also deletes the tree
+        fFile = nullptr;
+        fTree = nullptr;
+        fEntry = fNEntries = 0;
+    }
+
+private:
+    // Event and track cuts and Q-vectors of the current entry
+    bool Compute(QVectorEvent& out) {
+        // ------------------
+        // Event selection
+        // ------------------
+        if(nPVs!=1) return false;                // Only single collision events
+        if(nBackTracks < 10) return false;       // Ensure PbPb collision, not background
+        if(PVZ[0]<-100 || PVZ[0]>100) return false;  // Vertex within fiducial region
+        if(nVeloTracks<15) return false;         // Require enough tracks
+
+        // Track multiplicities
+        int nPrimaryForTracks = 0;
+        int nPrimaryBackTracks = 0;
+        int nPrimaryForTracks_1 = 0;
+        int nPrimaryForTracks_2 = 0;
+        int nPrimaryForTracks_3 = 0;
+
+        // Initialize Q-vectors (two harmonics: n=1,2)
+        for(int i = 0; i < 2; i++){
+            out.outQx_back[i] = out.outQy_back[i] = 0;
+            out.outQx_back_wEta[i] = out.outQy_back_wEta[i] = 0;
+            for(int j = 0; j < 4; j++){
+                out.outQx_for[i][j] = out.outQy_for[i][j] = 0;
+                out.outQx_for_wEta[i][j] = out.outQy_for_wEta[i][j] = 0;
+            }
+        }
+
+        // ------------------
+        // Loop over tracks
+        // ------------------
+        for(int iTrack = 0; iTrack < nVeloTracks; iTrack++){
+
+            // Basic track quality cut
+            if(VELOTRACK_BIPCHI2[iTrack]>1.5) continue;
+
+            // Handle backward tracks: flip eta and phi
+            if(VELOTRACK_ISBACKWARD[iTrack]==1) {
+                VELOTRACK_ETA[iTrack] *= -1;
+                VELOTRACK_PHI[iTrack] += TMath::Pi();
+            }
+
+            // Count forward/backward tracks
+            if(VELOTRACK_ISBACKWARD[iTrack]!=1) nPrimaryForTracks++;
+            if(VELOTRACK_ISBACKWARD[iTrack]==1) nPrimaryBackTracks++;
+
+            // Weights
+            double w1=1;              // default weight = 1
+            double w2=1;              // for n=2 harmonic
+            double wEta1=VELOTRACK_ETA[iTrack]; // eta-weighted option
+            double phi = VELOTRACK_PHI[iTrack];
+
+            // Backward eta region
+            if(VELOTRACK_ETA[iTrack] < -0.5){
+                // Harmonic n=1,2
+                out.outQx_back[0] += w1 * cos(1 * phi);
+                out.outQx_back[1] += w2 * cos(2 * phi);
+                out.outQy_back[0] += w1 * sin(1 * phi);
+                out.outQy_back[1] += w2 * sin(2 * phi);
+
+                // Eta-weighted
+                out.outQx_back_wEta[0] += wEta1 * cos(1 * phi);
+                out.outQy_back_wEta[0] += wEta1 * sin(1 * phi);
+            }
+
+            // Forward eta bins 1: 0.5–2.5, 2: 2.5–4.0, 3: 4.0–6.0 and inclusive 0.5–6.0
+            const double etaLow[4]  = {0.5, 2.5, 4.0, 0.5};
+            const double etaHigh[4] = {2.5, 4.0, 6.0, 6.0};
+            for(int j = 0; j < 4; j++){
+                if(VELOTRACK_ETA[iTrack] > etaLow[j] && VELOTRACK_ETA[iTrack] <= etaHigh[j]){
+                    out.outQx_for[0][j] += w1 * cos(1 * phi);
+                    out.outQx_for[1][j] += w2 * cos(2 * phi);
+                    out.outQy_for[0][j] += w1 * sin(1 * phi);
+                    out.outQy_for[1][j] += w2 * sin(2 * phi);
+
+                    out.outQx_for_wEta[0][j] += wEta1 * cos(1 * phi);
+                    out.outQy_for_wEta[0][j] += wEta1 * sin(1 * phi);
+                }
+            }
+            if(VELOTRACK_ETA[iTrack] > 0.5 && VELOTRACK_ETA[iTrack] <= 2.5) nPrimaryForTracks_1++;
+            if(VELOTRACK_ETA[iTrack] > 2.5 && VELOTRACK_ETA[iTrack] <= 4.0) nPrimaryForTracks_2++;
+            if(VELOTRACK_ETA[iTrack] > 4.0 && VELOTRACK_ETA[iTrack] <= 6.0) nPrimaryForTracks_3++;
+            if(VELOTRACK_ETA[iTrack] > 0.5 && VELOTRACK_ETA[iTrack] <= 6.0) nPrimaryForTracks++;
+        }// end of track loop
+
+        // ------------------
+        // Require enough tracks in all subevents
+        // ------------------
+        if(nPrimaryForTracks<5)     return false;
+        if(nPrimaryBackTracks<5)    return false;
+        if(nPrimaryForTracks_1<5)   return false;
+        if(nPrimaryForTracks_2<5)   return false;
+        if(nPrimaryForTracks_3<5)   return false;
+
+        out.outGPSTIME       = GPSTIME;
+        out.outEVENTNUMBER   = EVENTNUMBER;
+        out.outPVX           = PVX[0];
+        out.outPVY           = PVY[0];
+        out.outPVZ           = PVZ[0];
+        out.outRUNNUMBER     = RUNNUMBER;
+        out.outnBackTracks   = nBackTracks;
+        out.outnVeloClusters = nVeloClusters;
+        out.outnVeloTracks   = nVeloTracks;
+        out.outnEcalClusters = nEcalClusters;
+        out.outECalETot      = ECalETot;
+        out.outnLongTracks   = nLongTracks;
+        out.outnVPClusters   = nVPClusters;
+
+        out.out_Qmulti[0] = nPrimaryForTracks_1;
+        out.out_Qmulti[1] = nPrimaryForTracks_2;
+        out.out_Qmulti[2] = nPrimaryForTracks_3;
+        out.out_Qmulti[3] = nPrimaryBackTracks;
+        return true;
+    }
+
+    TFile*   fFile;
+    TTree*   fTree;
+    Long64_t fEntry;
+    Long64_t fNEntries;
+
+    // EventTuplePV branch variables
+    ULong64_t            GPSTIME;
+    ULong64_t            EVENTNUMBER;
+    std::vector<Float_t> PVX, PVY, PVZ;
+    UInt_t               RUNNUMBER;
+    std::vector<Float_t> VELOTRACK_BIPCHI2, VELOTRACK_ETA, VELOTRACK_ISBACKWARD, VELOTRACK_NVPHITS;
+    std::vector<Float_t> VELOTRACK_PHI, VELOTRACK_PX, VELOTRACK_PY, VELOTRACK_PZ, VELOTRACK_RHO;
+    Int_t                nBackTracks, nPVs, nVeloClusters, nVeloTracks;
+    Int_t                nEcalClusters, ECalETot, nLongTracks, nVPClusters;
+};
+
+#endif // EPQVectorReader_h
@@ -0,0 +1,215 @@
+// ============================================================================
+// EPTrace.h
+//
+// Timeline instrumentation of the three steps (Q-vectors, EP calibration,
+// Lambda matching) in the Chrome trace-event format, for chrome://tracing or
+// https://ui.perfetto.dev. Every input file, I/O stage, calibration pass and
+// matching loop is recorded with its begin time and duration on the thread
+// that ran it, so stalls, load imbalance between the worker threads and gaps
+// between the prefetch and the reading of a file show up directly.
+//
+// Tracing is off by default and then costs one flag test per scope. Enable
+// it for a whole job with the environment variable EP_TRACE, the trace is
+// written when the process exits:
+// > EP_TRACE=trace.json root -l -b -q 'GlobalPolarizationPipeline.C+(...)'
+// or from code with EPTrace::Instance().Start() ... Stop("trace.json").
+//
+// Instrumented code opens an EPTraceScope for the duration of a block:
+//   EPTraceScope scope("match", "step3", fileName);
+// The category is a string literal: "step1", "step2", "step3" for the
+// processing of each step, "io" for opening, prefetching and writing files.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef EPTrace_h
+#define EPTrace_h
+
+#include <Rtypes.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class EPTrace {
+public:
+    // Process-wide trace; started here if EP_TRACE is set
+    static EPTrace& Instance() {
+        static EPTrace trace;
+        return trace;
+    }
+
+    ~EPTrace() {
+        if (!fAutoFile.empty() && IsEnabled()) Stop(fAutoFile);
+    }
+
+    // Start recording; the calling thread is named "main" in the timeline
+    void Start() {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fEvents.clear();
+        fThreadNames.clear();
+        fMainThread = std::this_thread::get_id();
+        fStartUs.store(ClockUs(), std::memory_order_relaxed);
+        ++fSession;   // Threads register again in the new session
+        fEnabled.store(true, std::memory_order_release);
+    }
+
+    // Stop recording and write the trace to fileName. Returns false on error.
+    bool Stop(const std::string& fileName) {
+        fEnabled.store(false, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(fMutex);
+        std::ofstream out(fileName.c_str());
+        if (!out) {
+            std::cerr << "Could not create trace file " << fileName << std::endl;
+            return false;
+        }
+        const int pid = getpid();
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (size_t tid = 0; tid < fThreadNames.size(); ++tid) {
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid
+                << ",\"args\":{\"name\":\"" << Escape(fThreadNames[tid]) << "\"}},\n";
+        }
+        for (size_t i = 0; i < fEvents.size(); ++i) {
+            const TraceEvent& event = fEvents[i];
+            out << "{\"name\":\"" << Escape(event.name) << "\",\"cat\":\"" << event.cat << "\",\"ph\":\""
+                << event.phase << "\",\"pid\":" << pid << ",\"tid\":" << event.tid << ",\"ts\":" << event.ts;
+            if (event.phase == 'X') out << ",\"dur\":" << event.dur;
+            if (event.phase == 'i') out << ",\"s\":\"t\"";
+            if (!event.arg.empty()) out << ",\"args\":{\"file\":\"" << Escape(event.arg) << "\"}";
+            out << "}" << (i + 1 < fEvents.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        std::cout << "Trace with " << fEvents.size() << " events on " << fThreadNames.size()
+                  << " threads written to " << fileName << std::endl;
+        return true;
+    }
+
+    bool IsEnabled() const { return fEnabled.load(std::memory_order_relaxed); }
+
+    // Microseconds since Start(); the start time is atomic, so worker threads
+    // may call this while another thread restarts the trace
+    Long64_t Now() const { return ClockUs() - fStartUs.load(std::memory_order_relaxed); }
+
+    // Block [beginUs, endUs) of the calling thread; arg is shown as "file"
+    void Complete(const char* name, const char* cat, Long64_t beginUs, Long64_t endUs, const std::string& arg) {
+        if (IsEnabled()) Record(name, cat, 'X', beginUs, endUs - beginUs, arg);
+    }
+
+    // Point in time on the calling thread, e.g. a chain entering a new file.
+    // arg is only copied when tracing is on.
+    void Instant(const char* name, const char* cat, const char* arg = "") {
+        if (IsEnabled()) Record(name, cat, 'i', Now(), 0, arg);
+    }
+
+private:
+    struct TraceEvent {
+        std::string name;
+        const char* cat;    // String literal
+        char        phase;  // 'X' complete, 'i' instant
+        int         tid;
+        Long64_t    ts, dur;
+        std::string arg;
+    };
+
+    EPTrace() : fEnabled(false), fSession(0), fStartUs(ClockUs()) {
+        const char* autoFile = std::getenv("EP_TRACE");
+        if (autoFile && *autoFile) {
+            fAutoFile = autoFile;
+            Start();
+        }
+    }
+
+    // Steady clock in microseconds
+    static Long64_t ClockUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Record(const char* name, const char* cat, char phase, Long64_t ts, Long64_t dur, const std::string& arg) {
+        // Small sequential thread ids, renewed per session
+        thread_local int tid = -1;
+        thread_local int session = -1;
+        std::lock_guard<std::mutex> lock(fMutex);
+        if (!IsEnabled()) return;
+        if (session != fSession) {
+            tid = fThreadNames.size();
+            session = fSession;
+            fThreadNames.push_back(std::this_thread::get_id() == fMainThread ? std::string("main")
+                                                                             : "worker " + std::to_string(tid));
+        }
+        TraceEvent event;
+        event.name = name;
+        event.cat = cat;
+        event.phase = phase;
+        event.tid = tid;
+        event.ts = ts;
+        event.dur = dur;
+        event.arg = arg;
+        fEvents.push_back(event);
+    }
+
+    static std::string Escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if ((unsigned char)c < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+                escaped += code;
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    std::atomic<bool>                     fEnabled;
+    int                                   fSession;
+    std::atomic<Long64_t>                 fStartUs;       // ClockUs() at Start()
+    std::thread::id                       fMainThread;
+    std::mutex                            fMutex;
+    std::vector<TraceEvent>               fEvents;
+    std::vector<std::string>              fThreadNames;   // Indexed by trace thread id
+    std::string                           fAutoFile;      // From EP_TRACE
+};
+
+// ============================================================================
+// EPTraceScope: records the enclosing block as one timeline event
+// ============================================================================
+class EPTraceScope {
+public:
+    EPTraceScope(const char* name, const char* cat, const std::string& arg = "")
+        : fCat(cat), fBegin(-1) {
+        EPTrace& trace = EPTrace::Instance();
+        if (!trace.IsEnabled()) return;
+        fName = name;
+        fArg = arg;
+        fBegin = trace.Now();
+    }
+    ~EPTraceScope() {
+        if (fBegin < 0) return;
+        EPTrace& trace = EPTrace::Instance();
+        trace.Complete(fName.c_str(), fCat, fBegin, trace.Now(), fArg);
+    }
+
+private:
+    EPTraceScope(const EPTraceScope&);
+    EPTraceScope& operator=(const EPTraceScope&);
+
+    std::string fName;
+    const char* fCat;   // String literal
+    std::string fArg;
+    Long64_t    fBegin;
+};
+
+#endif // EPTrace_h
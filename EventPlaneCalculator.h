@@ -0,0 +1,586 @@
+// ============================================================================
+// EventPlaneCalculator.h
+//
+// Event-plane angles from VELO Q-vectors (LHCb Pb+Pb 2024).
+//
+// The corrections of calculateEventPlane.cpp in reusable form:
+//
+// - Q-vectors of the backward side, of one forward eta bin and of their sum
+//   ("full"), for n = 1 and n = 2; the forward n = 1 vector is sign-flipped
+//   (forward v1 is negative, backward positive)
+// - recentering: the mean (Qx, Qy) of each centrality bin is subtracted
+// - Psi_n = atan2(Qy, Qx) / n
+// - flattening shift with 8 Fourier moments of each centrality bin
+// - wrapping of Psi1 into [-pi, pi] and of Psi2 into [-pi/2, pi/2]
+// - resolution terms r1 = cos(Psi1back - Psi1for), r2 = cos 2(Psi2back - Psi2for)
+//
+// The calibration (means and shift moments) is copied from the weights file
+// written by calculateEventPlane(1/2) into plain arrays by Load(); the file is
+// closed afterwards. All other member functions are const and touch no ROOT
+// object, so one calculator can be shared by any number of threads.
+//
+// With ReadQVectorFile() the matching step (GlobalPolarizationAnalysis_FilePrep)
+// computes the EP angles directly from the step-1 Q-vector tuple, so a new
+// calibration only needs a new weights file, not a new EP file.
+// EPCalibrationStore runs the whole calibration in memory, without the
+// Q-vector tuple and the weights file (GlobalPolarizationPipeline.C), and
+// WriteEventPlaneCheckpoint() writes its EP file (ep-calibrate.cpp).
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef EventPlaneCalculator_h
+#define EventPlaneCalculator_h
+
+#include "EPDataModel.h"
+#include "EPMatchIndex.h"
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TH2D.h>
+#include <TProfile2D.h>
+#include <TMath.h>
+#include <TString.h>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// Q-vectors and multiplicities of one event, as stored by EventPlaneAnalysis
+// ============================================================================
+struct EPQVectors {
+    Int_t    nVeloTracks;
+    Int_t    nEcalClusters;
+    Double_t Qx_back[2];     // n = 1, 2
+    Double_t Qy_back[2];
+    Double_t Qx_for[2][4];   // n = 1, 2 and forward eta bin
+    Double_t Qy_for[2][4];
+};
+
+// Sub-detectors of the Q-vectors and angles
+enum EPSide {
+    kEPBack = 0,
+    kEPFor  = 1,
+    kEPFull = 2
+};
+
+class EventPlaneCalculator {
+public:
+    static const int kNCentBins = 3;
+    static const int kNSides    = 3;   // EPSide
+    static const int kNMoments  = 8;   // Fourier moments of the shift
+
+    explicit EventPlaneCalculator(int etaBin = 1) : fEtaBin(etaBin), fLoaded(false) {
+        for (int iCent = 0; iCent < kNCentBins; ++iCent)
+            for (int in = 0; in < 2; ++in)
+                for (int iSide = 0; iSide < kNSides; ++iSide) {
+                    fQxMean[iCent][in][iSide] = 0;
+                    fQyMean[iCent][in][iSide] = 0;
+                    for (int j = 0; j < kNMoments; ++j) {
+                        fShiftSin[iCent][in][iSide][j] = 0;
+                        fShiftCos[iCent][in][iSide][j] = 0;
+                    }
+                }
+    }
+
+    // Read the recentering means and shift moments of the forward eta bin
+    // from a weights file written by calculateEventPlane. Returns false on error.
+    bool Load(const std::string& weightsFileName) {
+        EPTraceScope trace("load EP weights", "io", weightsFileName);
+        fLoaded = false;
+        const int etaBin = fEtaBin;
+        TFile* fWeights = TFile::Open(weightsFileName.c_str());
+        if (!fWeights || fWeights->IsZombie()) {
+            std::cerr << "Cannot open EP weights file " << weightsFileName << std::endl;
+            delete fWeights;
+            return false;
+        }
+        TH2D* hQxQy[kNCentBins][2][kNSides];
+        TProfile2D *hSin[kNCentBins], *hCos[kNCentBins];
+        for (int iCent = 0; iCent < kNCentBins; ++iCent) {
+            for (int in = 0; in < 2; ++in) {
+                for (int iSide = 0; iSide < kNSides; ++iSide) {
+                    TString name = QxQyName(in, iCent, iSide, etaBin);
+                    hQxQy[iCent][in][iSide] = (TH2D*)fWeights->Get(name);
+                    if (!hQxQy[iCent][in][iSide]) {
+                        std::cerr << "Cannot find " << name << " in " << weightsFileName << std::endl;
+                        delete fWeights;
+                        return false;
+                    }
+                }
+            }
+            hSin[iCent] = (TProfile2D*)fWeights->Get(Form("hEPshift_sin_cent%d", iCent));
+            hCos[iCent] = (TProfile2D*)fWeights->Get(Form("hEPshift_cos_cent%d", iCent));
+            if (!hSin[iCent] || !hCos[iCent]) {
+                std::cerr << "Cannot find hEPshift_sin/cos_cent" << iCent << " in " << weightsFileName << std::endl;
+                delete fWeights;
+                return false;
+            }
+        }
+        SetCalibration(hQxQy, hSin, hCos, weightsFileName);
+        delete fWeights;
+        return true;
+    }
+
+    // Take the calibration from the weights histograms of calculateEventPlane:
+    // recentering means from hQxQy[cent][n - 1][side], shift moments from
+    // hSin/hCos[cent] (x bin iep + 1: 0 - psi1 back, 1 - psi1 for, 2 - psi1 full,
+    // 3-5 the same for psi2; y bin j: moment j). Without shift profiles
+    // (nullptr) the angles are only recentered. source names the calibration.
+    void SetCalibration(TH2D* const hQxQy[kNCentBins][2][kNSides], TProfile2D* const hSin[kNCentBins],
+                        TProfile2D* const hCos[kNCentBins], const std::string& source) {
+        for (int iCent = 0; iCent < kNCentBins; ++iCent) {
+            for (int in = 0; in < 2; ++in)
+                for (int iSide = 0; iSide < kNSides; ++iSide) {
+                    fQxMean[iCent][in][iSide] = hQxQy[iCent][in][iSide]->GetMean(1);
+                    fQyMean[iCent][in][iSide] = hQxQy[iCent][in][iSide]->GetMean(2);
+                    for (int j = 1; j <= kNMoments; ++j) {
+                        fShiftSin[iCent][in][iSide][j - 1] = hSin ? hSin[iCent]->GetBinContent(3 * in + iSide + 1, j) : 0;
+                        fShiftCos[iCent][in][iSide][j - 1] = hCos ? hCos[iCent]->GetBinContent(3 * in + iSide + 1, j) : 0;
+                    }
+                }
+        }
+        fWeightsFileName = source;
+        fLoaded = true;
+    }
+
+    // Name of the recentering histogram of side iSide in the weights file
+    static TString QxQyName(int in, int iCent, int iSide, int etaBin) {
+        if (iSide == kEPBack) return Form("hQxQy_back_n%d_cent%d", in, iCent);
+        if (iSide == kEPFor) return Form("hQxQy_for_n%d_cent%d_Eta%d", in, iCent, etaBin);
+        return Form("hQxQy_full_n%d_cent%d_Eta%d", in, iCent, etaBin);
+    }
+
+    bool IsLoaded() const { return fLoaded; }
+    int GetEtaBin() const { return fEtaBin; }
+    const std::string& GetWeightsFileName() const { return fWeightsFileName; }
+
+    // Event selection of calculateEventPlane (removes events with many VELO
+    // tracks but few ECAL clusters)
+    static bool AcceptEvent(Int_t nVeloTracks, Int_t nEcalClusters) {
+        return !(nVeloTracks > 1000 && nEcalClusters < 480);
+    }
+
+    // Centrality bin in nVeloTracks: bin k covers (edge[k], edge[k+1]];
+    // tracks outside all bins go to the last bin, as in calculateEventPlane
+    static int CentralityBin(Int_t nVeloTracks) {
+        static const Int_t edges[kNCentBins + 1] = {14, 126, 270, 2000};
+        int centBin = kNCentBins - 1;
+        for (int iCent = 0; iCent < kNCentBins; ++iCent)
+            if (nVeloTracks > edges[iCent] && nVeloTracks <= edges[iCent + 1]) centBin = iCent;
+        return centBin;
+    }
+
+    // Uncorrected Q-vectors [n - 1][EPSide] of forward eta bin fEtaBin
+    void RawQVectors(const EPQVectors& q, Double_t Qx[2][kNSides], Double_t Qy[2][kNSides]) const {
+        const int a = -1, b = 1;   // Forward v1 is negative, backward positive
+        Qx[0][kEPBack] = b * q.Qx_back[0];          Qy[0][kEPBack] = b * q.Qy_back[0];
+        Qx[0][kEPFor]  = a * q.Qx_for[0][fEtaBin];  Qy[0][kEPFor]  = a * q.Qy_for[0][fEtaBin];
+        Qx[1][kEPBack] = q.Qx_back[1];              Qy[1][kEPBack] = q.Qy_back[1];
+        Qx[1][kEPFor]  = q.Qx_for[1][fEtaBin];      Qy[1][kEPFor]  = q.Qy_for[1][fEtaBin];
+        for (int in = 0; in < 2; ++in) {
+            Qx[in][kEPFull] = Qx[in][kEPBack] + Qx[in][kEPFor];
+            Qy[in][kEPFull] = Qy[in][kEPBack] + Qy[in][kEPFor];
+        }
+    }
+
+    // Subtract the mean Q-vectors of centrality bin centBin
+    void Recenter(int centBin, Double_t Qx[2][kNSides], Double_t Qy[2][kNSides]) const {
+        for (int in = 0; in < 2; ++in)
+            for (int iSide = 0; iSide < kNSides; ++iSide) {
+                Qx[in][iSide] -= fQxMean[centBin][in][iSide];
+                Qy[in][iSide] -= fQyMean[centBin][in][iSide];
+            }
+    }
+
+    // Psi_n = atan2(Qy, Qx) / n
+    static void Angles(const Double_t Qx[2][kNSides], const Double_t Qy[2][kNSides], Double_t psi[2][kNSides]) {
+        for (int in = 0; in < 2; ++in)
+            for (int iSide = 0; iSide < kNSides; ++iSide)
+                psi[in][iSide] = TMath::ATan2(Qy[in][iSide], Qx[in][iSide]) / (in + 1);
+    }
+
+    // Flattening shift of angle psi of order n = in + 1, side iSide
+    Double_t Shift(int centBin, int in, int iSide, Double_t psi) const {
+        const int n = in + 1;
+        Double_t shifted = psi;
+        for (int j = 1; j <= kNMoments; ++j)
+            shifted += (2.0 / j) * (-fShiftSin[centBin][in][iSide][j - 1] * TMath::Cos(j * n * psi) +
+                                    fShiftCos[centBin][in][iSide][j - 1] * TMath::Sin(j * n * psi)) / n;
+        return shifted;
+    }
+
+    // Wrap Psi1 into [-pi, pi] and Psi2 into [-pi/2, pi/2]
+    static Double_t WrapPsi1(Double_t psi) {
+        if (TMath::Abs(psi) < TMath::Pi()) return psi;
+        return psi < 0 ? psi + TMath::TwoPi() : psi - TMath::TwoPi();
+    }
+    static Double_t WrapPsi2(Double_t psi) {
+        if (TMath::Abs(psi) < 0.5 * TMath::Pi()) return psi;
+        return psi < 0 ? psi + TMath::Pi() : psi - TMath::Pi();
+    }
+
+    // Fully corrected EP angles and resolution terms of one event
+    void Calculate(const EPQVectors& q, EPPayload& ep) const {
+        Double_t Qx[2][kNSides], Qy[2][kNSides];
+        RawQVectors(q, Qx, Qy);
+        CalculateFromRaw(CentralityBin(q.nVeloTracks), Qx, Qy, ep);
+    }
+
+    // The same from the uncorrected Q-vectors (RawQVectors) of centrality bin centBin
+    void CalculateFromRaw(int centBin, const Double_t rawQx[2][kNSides], const Double_t rawQy[2][kNSides],
+                          EPPayload& ep) const {
+        Double_t Qx[2][kNSides], Qy[2][kNSides], psi[2][kNSides];
+        for (int in = 0; in < 2; ++in)
+            for (int iSide = 0; iSide < kNSides; ++iSide) {
+                Qx[in][iSide] = rawQx[in][iSide];
+                Qy[in][iSide] = rawQy[in][iSide];
+            }
+        Recenter(centBin, Qx, Qy);
+        Angles(Qx, Qy, psi);
+        for (int iSide = 0; iSide < kNSides; ++iSide) {
+            psi[0][iSide] = WrapPsi1(Shift(centBin, 0, iSide, psi[0][iSide]));
+            psi[1][iSide] = WrapPsi2(Shift(centBin, 1, iSide, psi[1][iSide]));
+        }
+        ep.Psi1Full   = psi[0][kEPFull];
+        ep.Psi2Full   = psi[1][kEPFull];
+        ep.PsiBack[0] = psi[0][kEPBack];
+        ep.PsiBack[1] = psi[1][kEPBack];
+        ep.PsiFor[0]  = psi[0][kEPFor];
+        ep.PsiFor[1]  = psi[1][kEPFor];
+        ep.r1 = TMath::Cos(psi[0][kEPBack] - psi[0][kEPFor]);
+        ep.r2 = TMath::Cos(2 * (psi[1][kEPBack] - psi[1][kEPFor]));
+    }
+
+private:
+    int         fEtaBin;                                             // Forward eta bin of the EP
+    bool        fLoaded;
+    std::string fWeightsFileName;
+    Double_t    fQxMean[kNCentBins][2][kNSides];                     // Recentering, [cent][n - 1][side]
+    Double_t    fQyMean[kNCentBins][2][kNSides];
+    Double_t    fShiftSin[kNCentBins][2][kNSides][kNMoments];        // <sin(j n Psi)>
+    Double_t    fShiftCos[kNCentBins][2][kNSides][kNMoments];        // <cos(j n Psi)>
+};
+
+// ============================================================================
+// ForEachQVectorEvent
+// ============================================================================
+// Reads the keys and Q-vectors of the split "event" branch of the step-1
+// tuple (EventPlaneTuple of EventPlaneAnalysis) in one sequential pass and
+// calls f(entry, run, event, q) for every entry; only these branches are
+// read. Returns false on error.
+template <class Function>
+inline bool ForEachQVectorEvent(const std::string& qFileName, Function f) {
+    TFile* qFile = TFile::Open(qFileName.c_str());
+    if (!qFile || qFile->IsZombie()) {
+        std::cerr << "Could not open Q-vector file: " << qFileName << std::endl;
+        delete qFile;
+        return false;
+    }
+    TTree* qTree = (TTree*)qFile->Get("EventPlaneTuple");
+    if (!qTree) {
+        std::cerr << "Cannot find tree 'EventPlaneTuple' in " << qFileName << std::endl;
+        delete qFile;
+        return false;
+    }
+
+    UInt_t run = 0;
+    ULong64_t event = 0;
+    EPQVectors q;
+    const char* names[] = {"outRUNNUMBER", "outEVENTNUMBER", "outnVeloTracks", "outnEcalClusters",
+                           "outQx_back[2]", "outQy_back[2]", "outQx_for[2][4]", "outQy_for[2][4]"};
+    void* addresses[] = {&run, &event, &q.nVeloTracks, &q.nEcalClusters,
+                         q.Qx_back, q.Qy_back, q.Qx_for, q.Qy_for};
+    qTree->SetMakeClass(1);   // Leaves bound to plain variables, as in EPMatchIndex::ReadEPFile
+    qTree->SetCacheSize(64 * 1024 * 1024);   // Read the baskets in bulk
+    std::vector<TBranch*> leaves;
+    for (int k = 0; k < 8; ++k) {
+        TBranch* branch = qTree->GetBranch(names[k]);
+        if (!branch) {
+            std::cerr << "Cannot find branch '" << names[k] << "' in 'EventPlaneTuple'." << std::endl;
+            delete qFile;
+            return false;
+        }
+        qTree->SetBranchAddress(names[k], addresses[k]);
+        qTree->AddBranchToCache(branch);
+        leaves.push_back(branch);
+    }
+    qTree->StopCacheLearningPhase();
+
+    Long64_t nQ = qTree->GetEntries();
+    for (Long64_t iQ = 0; iQ < nQ; ++iQ) {
+        for (auto branch : leaves) branch->GetEntry(iQ);
+        f(iQ, run, event, q);
+    }
+    delete qFile;
+    return true;
+}
+
+// ============================================================================
+// ReadQVectorFile
+// ============================================================================
+// Computes the EP angles of every accepted event of a step-1 Q-vector tuple
+// with calc. Output as for EPMatchIndex::Build: payload is indexed by
+// Q-vector tuple entry, rejected events get no key. Returns false on error.
+inline bool ReadQVectorFile(const std::string& qFileName, const EventPlaneCalculator& calc,
+                            std::vector<std::pair<EPKey, Long64_t> >& pairs, std::vector<EPPayload>& payload) {
+    if (!calc.IsLoaded()) {
+        std::cerr << "EP calibration not loaded." << std::endl;
+        return false;
+    }
+    pairs.clear();
+    payload.clear();
+    return ForEachQVectorEvent(qFileName, [&](Long64_t iQ, UInt_t run, ULong64_t event, const EPQVectors& q) {
+        payload.resize(iQ + 1);
+        if (!EventPlaneCalculator::AcceptEvent(q.nVeloTracks, q.nEcalClusters)) return;
+        calc.Calculate(q, payload[iQ]);
+        pairs.push_back(std::make_pair(MakeEPKey(run, event), iQ));
+    });
+}
+
+// ============================================================================
+// EPCalibrationStore
+// ============================================================================
+// In-memory stand-in for the Q-vector tuple and the weights file, used by the
+// in-process pipeline (GlobalPolarizationPipeline.C). Events are added as
+// step 1 produces them; only the key, the centrality bin and the uncorrected
+// Q-vectors of the calculator's eta bin are kept (81 bytes per event).
+// Calibrate() then runs the calibration passes of calculateEventPlane on
+// them: pass 1 fills the recentering histograms, pass 2 the shift profiles
+// of the recentered angles. The histograms are the same as in the weights
+// file, so the calibration is identical to calculateEventPlane(1), (2) on the
+// same events and can be written as a weights file (WriteWeights()).
+// BuildIndex() then applies the final corrections and fills an EPMatchIndex.
+class EPCalibrationStore {
+public:
+    static const int kNCentBins = EventPlaneCalculator::kNCentBins;
+    static const int kNSides = EventPlaneCalculator::kNSides;
+
+    explicit EPCalibrationStore(int etaBin = 1) : fCalc(etaBin) {
+        for (int iCent = 0; iCent < kNCentBins; ++iCent) {
+            for (int in = 0; in < 2; ++in)
+                for (int iSide = 0; iSide < kNSides; ++iSide) fQxQy[iCent][in][iSide] = nullptr;
+            fShiftSin[iCent] = fShiftCos[iCent] = nullptr;
+        }
+    }
+    ~EPCalibrationStore() { DeleteHistograms(); }
+
+    // Add one event; events failing EventPlaneCalculator::AcceptEvent are
+    // not stored (returns false)
+    bool Add(UInt_t run, ULong64_t event, const EPQVectors& q) {
+        if (!EventPlaneCalculator::AcceptEvent(q.nVeloTracks, q.nEcalClusters)) return false;
+        Double_t Qx[2][kNSides], Qy[2][kNSides];
+        fCalc.RawQVectors(q, Qx, Qy);
+        StoredQ stored;
+        for (int in = 0; in < 2; ++in) {
+            stored.Qx[in][0] = Qx[in][kEPBack];  stored.Qy[in][0] = Qy[in][kEPBack];
+            stored.Qx[in][1] = Qx[in][kEPFor];   stored.Qy[in][1] = Qy[in][kEPFor];
+        }
+        fKeys.push_back(MakeEPKey(run, event));
+        fQ.push_back(stored);
+        fCentBin.push_back((UChar_t)EventPlaneCalculator::CentralityBin(q.nVeloTracks));
+        return true;
+    }
+
+    // Append the events of another store (e.g. of another AP file) and free it
+    void Append(EPCalibrationStore& other) {
+        fKeys.insert(fKeys.end(), other.fKeys.begin(), other.fKeys.end());
+        fQ.insert(fQ.end(), other.fQ.begin(), other.fQ.end());
+        fCentBin.insert(fCentBin.end(), other.fCentBin.begin(), other.fCentBin.end());
+        std::vector<EPKey>().swap(other.fKeys);
+        std::vector<StoredQ>().swap(other.fQ);
+        std::vector<UChar_t>().swap(other.fCentBin);
+    }
+
+    Long64_t GetN() const { return fKeys.size(); }
+    const EPKey& GetKey(Long64_t i) const { return fKeys[i]; }
+    const EventPlaneCalculator& GetCalculator() const { return fCalc; }
+    Long64_t GetMemoryBytes() const { return GetN() * (Long64_t)(sizeof(EPKey) + sizeof(StoredQ) + sizeof(UChar_t)); }
+
+    // Recentering (pass 1) and shift (pass 2) calibration of the stored
+    // events; the calculator is then final. Returns false without events.
+    bool Calibrate() {
+        if (fKeys.empty()) {
+            std::cerr << "No events for the EP calibration." << std::endl;
+            return false;
+        }
+        DeleteHistograms();
+        const int iEta = fCalc.GetEtaBin();
+        int qbins = 20; double qmin = -10; double qmax = 10;
+        for (int iCent = 0; iCent < kNCentBins; ++iCent) {
+            for (int in = 0; in < 2; ++in) {
+                const TString titles[kNSides] = {TString::Format("hQxQy_back_n%d_cent%d; Qx; Qy;", in, iCent),
+                                                 TString::Format("hQxQy_for_n%d_cent%d_eta%d; Qx; Qy;", in, iCent, iEta),
+                                                 TString::Format("hQxQy_full_n%d_cent%d_eta%d; Qx; Qy;", in, iCent, iEta)};
+                for (int iSide = 0; iSide < kNSides; ++iSide) {
+                    const TString& title = titles[iSide];
+                    fQxQy[iCent][in][iSide] = new TH2D(EventPlaneCalculator::QxQyName(in, iCent, iSide, iEta), title,
+                                                       qbins, qmin, qmax, qbins, qmin, qmax);
+                    fQxQy[iCent][in][iSide]->SetDirectory(nullptr);
+                }
+            }
+            fShiftSin[iCent] = new TProfile2D(Form("hEPshift_sin_cent%d", iCent), "", 6, -0.5, 5.5, 9, 0.5, 9.5, -2.0, 2.0, "");
+            fShiftCos[iCent] = new TProfile2D(Form("hEPshift_cos_cent%d", iCent), "", 6, -0.5, 5.5, 9, 0.5, 9.5, -2.0, 2.0, "");
+            fShiftSin[iCent]->SetDirectory(nullptr);
+            fShiftCos[iCent]->SetDirectory(nullptr);
+        }
+
+        // Pass 1: mean Q-vectors
+        Double_t Qx[2][kNSides], Qy[2][kNSides], psi[2][kNSides];
+        {
+            EPTraceScope trace("recentering pass", "step2");
+            for (size_t i = 0; i < fKeys.size(); ++i) {
+                RawQVectors(i, Qx, Qy);
+                for (int in = 0; in < 2; ++in)
+                    for (int iSide = 0; iSide < kNSides; ++iSide)
+                        fQxQy[fCentBin[i]][in][iSide]->Fill(Qx[in][iSide], Qy[in][iSide]);
+            }
+        }
+        fCalc.SetCalibration(fQxQy, nullptr, nullptr, "in-memory calibration (recentering)");
+
+        // Pass 2: Fourier moments of the recentered angles
+        {
+            EPTraceScope trace("shift pass", "step2");
+            for (size_t i = 0; i < fKeys.size(); ++i) {
+                const int centBin = fCentBin[i];
+                RawQVectors(i, Qx, Qy);
+                fCalc.Recenter(centBin, Qx, Qy);
+                EventPlaneCalculator::Angles(Qx, Qy, psi);
+                for (int j = 1; j <= EventPlaneCalculator::kNMoments; ++j)
+                    for (int in = 0; in < 2; ++in)
+                        for (int iSide = 0; iSide < kNSides; ++iSide) {
+                            fShiftSin[centBin]->Fill(3 * in + iSide, j, TMath::Sin(j * (in + 1) * psi[in][iSide]));
+                            fShiftCos[centBin]->Fill(3 * in + iSide, j, TMath::Cos(j * (in + 1) * psi[in][iSide]));
+                        }
+            }
+        }
+        fCalc.SetCalibration(fQxQy, fShiftSin, fShiftCos, "in-memory calibration");
+        return true;
+    }
+
+    // Write the calibration histograms as a weights file of calculateEventPlane
+    bool WriteWeights(const std::string& fileName) const {
+        if (!fShiftSin[0]) {
+            std::cerr << "EP calibration not done, no weights to write." << std::endl;
+            return false;
+        }
+        TFile* weightsFile = TFile::Open(fileName.c_str(), "RECREATE");
+        if (!weightsFile || weightsFile->IsZombie()) {
+            std::cerr << "Could not create weights file: " << fileName << std::endl;
+            delete weightsFile;
+            return false;
+        }
+        for (int iCent = 0; iCent < kNCentBins; ++iCent) {
+            fShiftSin[iCent]->Write();
+            fShiftCos[iCent]->Write();
+            for (int in = 0; in < 2; ++in)
+                for (int iSide = 0; iSide < kNSides; ++iSide) fQxQy[iCent][in][iSide]->Write();
+        }
+        weightsFile->Close();
+        delete weightsFile;
+        return true;
+    }
+
+    // Fully corrected EP angles of every stored event (payload[i] for event i)
+    // and the index over them; EP entry numbers are store positions
+    bool BuildIndex(EPMatchIndex& index, std::vector<EPPayload>& payload) const {
+        if (!fCalc.IsLoaded()) {
+            std::cerr << "EP calibration not done." << std::endl;
+            return false;
+        }
+        EPTraceScope trace("EP angles", "step2");
+        std::vector<std::pair<EPKey, Long64_t> > pairs;
+        pairs.reserve(fKeys.size());
+        payload.resize(fKeys.size());
+        Double_t Qx[2][kNSides], Qy[2][kNSides];
+        for (size_t i = 0; i < fKeys.size(); ++i) {
+            RawQVectors(i, Qx, Qy);
+            fCalc.CalculateFromRaw(fCentBin[i], Qx, Qy, payload[i]);
+            pairs.push_back(std::make_pair(fKeys[i], (Long64_t)i));
+        }
+        index.Build(pairs, &payload);
+        return true;
+    }
+
+private:
+    struct StoredQ {
+        Double_t Qx[2][2];   // [n - 1][back, forward]
+        Double_t Qy[2][2];
+    };
+
+    // Uncorrected Q-vectors [n - 1][EPSide] of stored event i
+    void RawQVectors(size_t i, Double_t Qx[2][kNSides], Double_t Qy[2][kNSides]) const {
+        const StoredQ& stored = fQ[i];
+        for (int in = 0; in < 2; ++in) {
+            Qx[in][kEPBack] = stored.Qx[in][0];  Qy[in][kEPBack] = stored.Qy[in][0];
+            Qx[in][kEPFor]  = stored.Qx[in][1];  Qy[in][kEPFor]  = stored.Qy[in][1];
+            Qx[in][kEPFull] = stored.Qx[in][0] + stored.Qx[in][1];
+            Qy[in][kEPFull] = stored.Qy[in][0] + stored.Qy[in][1];
+        }
+    }
+
+    void DeleteHistograms() {
+        for (int iCent = 0; iCent < kNCentBins; ++iCent) {
+            for (int in = 0; in < 2; ++in)
+                for (int iSide = 0; iSide < kNSides; ++iSide) {
+                    delete fQxQy[iCent][in][iSide];
+                    fQxQy[iCent][in][iSide] = nullptr;
+                }
+            delete fShiftSin[iCent];
+            delete fShiftCos[iCent];
+            fShiftSin[iCent] = fShiftCos[iCent] = nullptr;
+        }
+    }
+
+    EventPlaneCalculator  fCalc;
+    std::vector<EPKey>    fKeys;
+    std::vector<StoredQ>  fQ;
+    std::vector<UChar_t>  fCentBin;
+    TH2D*                 fQxQy[kNCentBins][2][kNSides];   // Recentering histograms, as in the weights file
+    TProfile2D*           fShiftSin[kNCentBins];           // Shift profiles, as in the weights file
+    TProfile2D*           fShiftCos[kNCentBins];
+};
+
+// ============================================================================
+// WriteEventPlaneCheckpoint
+// ============================================================================
+// EP file in the format of calculateEventPlane, entries in store order so
+// that the entry numbers of the index refer to it
+inline bool WriteEventPlaneCheckpoint(const std::string& fileName, const EPCalibrationStore& store,
+                                      const std::vector<EPPayload>& payload) {
+    EPTraceScope trace("write EP file", "io", fileName);
+    TFile* outFile = TFile::Open(fileName.c_str(), "RECREATE");
+    if (!outFile || outFile->IsZombie()) {
+        std::cerr << "Could not create EP file: " << fileName << std::endl;
+        delete outFile;
+        return false;
+    }
+    TTree* outTree = new TTree("EventPlaneTuple", "Event Plane");
+    EventPlane* ep = new EventPlane();
+    outTree->Branch("eventplane", &ep);
+    for (Long64_t i = 0; i < store.GetN(); ++i) {
+        const EPKey& key = store.GetKey(i);
+        ep->EVENTNUMBER = key.EVENTNUMBER;
+        ep->RUNNUMBER   = key.RUNNUMBER;
+        ep->Psi1Full    = payload[i].Psi1Full;
+        ep->Psi2Full    = payload[i].Psi2Full;
+        ep->PsiBack[0]  = payload[i].PsiBack[0];
+        ep->PsiBack[1]  = payload[i].PsiBack[1];
+        ep->PsiFor[0]   = payload[i].PsiFor[0];
+        ep->PsiFor[1]   = payload[i].PsiFor[1];
+        ep->r1          = payload[i].r1;
+        ep->r2          = payload[i].r2;
+        outTree->Fill();
+    }
+    outFile->cd();
+    outTree->Write();
+    outFile->Close();
+    delete outFile;
+    delete ep;
+    return true;
+}
+
+#endif // EventPlaneCalculator_h
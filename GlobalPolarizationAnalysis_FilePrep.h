@@ -3,10 +3,13 @@
 //
 // Header file for Global Polarization Analysis (LHCb Pb+Pb 2024)
 //
-// Defines data structures used in the analysis: EventPlane, Event, Lambda,
-// and Daughter classes, each corresponding to a set of variables stored in
-// ROOT trees. These classes facilitate I/O and cut-based selection for
-// polarization studies.
+// Defines the matching and output modes of the matching step. The data
+// classes stored in ROOT trees (EventPlane, Event, Lambda and Daughter) are
+// those of the shared data-model library, see EPDataModel.h.
+//
+// Lambda, Daughter and Event are written as split branches, each field is
+// its own column. BranchFlatOutput() writes the same fields as flat
+// leaf-list columns instead.
 //
 // Author: Maria Stefaniak
 // Affiliation: The Ohio State University
@@ -29,73 +32,86 @@
 #include <vector>
 #include <string>
 #include <TRegexp.h>
+#include <Rtypes.h>
 
-// ============================================================================
-// Class storing event plane information matched by (RUNNUMBER, EVENTNUMBER)
-// ============================================================================
-class EventPlane {
-public:
-    ULong64_t EVENTNUMBER;   // Unique event ID
-    UInt_t    RUNNUMBER;     // Run ID
-    Double_t  Psi1Full;      // Full Psi1 event plane angle
-    Double_t  Psi2Full;      // Full Psi2 event plane angle
-    Double_t  PsiBack[2];    // Psi1 and Psi2 from backward side
-    Double_t  PsiFor[2];     // Psi1 and Psi2 from forward side
-    Double_t  r1;            // Resolution for Psi1
-    Double_t  r2;            // Resolution for Psi2
-
-    EventPlane() : EVENTNUMBER(0), RUNNUMBER(0) {}
-};
+#include "EPDataModel.h"
 
 // ============================================================================
-// Class storing global event-level quantities for a Lambda event
+// Strategies for matching Lambda candidates to the EP file
 // ============================================================================
-class Event {
-public:
-    ULong64_t EVENTNUMBER;
-    UInt_t    RUNNUMBER;
-    Double_t  Psi1Full, Psi2Full;
-    Double_t  Psi1back, Psi2back;
-    Double_t  Psi1for, Psi2for;
-    Double_t  r1, r2;
-    Float_t   PVX, PVY, PVZ;               // Primary vertex position
-    Int_t     nBackTracks, nVeloTracks;    // Event multiplicity info
-    Int_t     nEcalClusters;               // Not used in cuts (but stored)
-
-    Event() : EVENTNUMBER(0), RUNNUMBER(0) {}
+enum EPJoinMode {
+    kHashJoin  = 0,   // Probe the EP index for each candidate
+    kMergeJoin = 1    // Sorted merge of candidates and EP keys
 };
 
 // ============================================================================
-// Lambda candidate reconstructed from proton and pion daughters
+// Output of the matching step
 // ============================================================================
-class Lambda {
-public:
-    Int_t     ID;
-    Float_t   ETA, PHI;
-    Double_t  MASS;
-    Float_t   PT, PX, PY, PZ;
-    Float_t   BPVIPCHI2;     // Impact parameter chi2 w.r.t. PV
-    Float_t   BPVFDCHI2;     // Flight distance chi2 w.r.t. PV
-    Float_t   B_PV_Z, B_PV_X, B_PV_Y; // PV position
-    Float_t   BPVDIRA;       // Direction angle cosine
-
-    Lambda() : ID(0) {}
+enum FilePrepOutputMode {
+    kOutputCopy         = 0,   // LambdaEventPlaneTree with event, EP and candidate copies
+    kOutputFriendEntry  = 1,   // Friend of DecayTree: selection flag and EP entry number
+    kOutputFriendAngles = 2,   // Friend of DecayTree: selection flag and EP angles
+    kOutputFlat         = 3    // LambdaEventPlaneTree with one flat column per field
 };
 
 // ============================================================================
-// Daughter particle (proton or pion) from Lambda decay
+// Flat output columns
 // ============================================================================
-class Daughter {
-public:
-    Int_t     ID;
-    Float_t   ETA, PHI;
-    Double_t  MASS;
-    Float_t   PT, PX, PY, PZ;
-    Double_t  BPVIPCHI2;
-    Double_t  GHOSTPROB;
+// Branches every field of evt, L0, proton and pion as its own leaf-list
+// column (L0_MASS, p_PT, ..., as in the DecayTree), with the same packing as
+// the class members. The branches point into the objects, so filling them and
+// calling tree->Fill() writes one row. Reading needs no class dictionary,
+// e.g. tree->Draw("L0_MASS") or RDataFrame reads only the columns it uses.
+inline void BranchFlatOutput(TTree* tree, Event* evt, Lambda* L0, Daughter* proton, Daughter* pion) {
+    tree->Branch("EVENTNUMBER",   &evt->EVENTNUMBER,   "EVENTNUMBER/l");
+    tree->Branch("RUNNUMBER",     &evt->RUNNUMBER,     "RUNNUMBER/i");
+    tree->Branch("Psi1Full",      &evt->Psi1Full,      "Psi1Full/D");
+    tree->Branch("Psi2Full",      &evt->Psi2Full,      "Psi2Full/D");
+    tree->Branch("Psi1back",      &evt->Psi1back,      "Psi1back/D");
+    tree->Branch("Psi2back",      &evt->Psi2back,      "Psi2back/D");
+    tree->Branch("Psi1for",       &evt->Psi1for,       "Psi1for/D");
+    tree->Branch("Psi2for",       &evt->Psi2for,       "Psi2for/D");
+    tree->Branch("r1",            &evt->r1,            "r1/D");
+    tree->Branch("r2",            &evt->r2,            "r2/D");
+    tree->Branch("PVX",           &evt->PVX,           "PVX/F");
+    tree->Branch("PVY",           &evt->PVY,           "PVY/F");
+    tree->Branch("PVZ",           &evt->PVZ,           "PVZ/F");
+    tree->Branch("nBackTracks",   &evt->nBackTracks,   "nBackTracks/I");
+    tree->Branch("nVeloTracks",   &evt->nVeloTracks,   "nVeloTracks/I");
+    tree->Branch("nEcalClusters", &evt->nEcalClusters, "nEcalClusters/I");
 
-    Daughter() : ID(0) {}
-};
+    tree->Branch("L0_MASS",      &L0->MASS,      "L0_MASS/d");
+    tree->Branch("L0_PT",        &L0->PT,        "L0_PT/F");
+    tree->Branch("L0_PX",        &L0->PX,        "L0_PX/F");
+    tree->Branch("L0_PY",        &L0->PY,        "L0_PY/F");
+    tree->Branch("L0_PZ",        &L0->PZ,        "L0_PZ/F");
+    tree->Branch("L0_B_PV_X",    &L0->B_PV_X,    "L0_B_PV_X/F");
+    tree->Branch("L0_B_PV_Y",    &L0->B_PV_Y,    "L0_B_PV_Y/F");
+    tree->Branch("L0_B_PV_Z",    &L0->B_PV_Z,    "L0_B_PV_Z/F");
+    tree->Branch("L0_BPVDIRA",   &L0->BPVDIRA,   "L0_BPVDIRA/F");
+    tree->Branch("L0_ETA",       &L0->ETA,       "L0_ETA/f[0,0,14]");
+    tree->Branch("L0_PHI",       &L0->PHI,       "L0_PHI/f[0,0,14]");
+    tree->Branch("L0_BPVIPCHI2", &L0->BPVIPCHI2, "L0_BPVIPCHI2/f[0,0,10]");
+    tree->Branch("L0_BPVFDCHI2", &L0->BPVFDCHI2, "L0_BPVFDCHI2/f[0,0,10]");
+    tree->Branch("L0_ID",        &L0->ID,        "L0_ID/S");
+
+    Daughter* daughters[2] = {proton, pion};
+    const char* prefixes[2] = {"p", "pi"};
+    for (int k = 0; k < 2; ++k) {
+        Daughter* d = daughters[k];
+        TString pre = prefixes[k];
+        tree->Branch(pre + "_MASS",      &d->MASS,      pre + "_MASS/d");
+        tree->Branch(pre + "_PT",        &d->PT,        pre + "_PT/F");
+        tree->Branch(pre + "_PX",        &d->PX,        pre + "_PX/F");
+        tree->Branch(pre + "_PY",        &d->PY,        pre + "_PY/F");
+        tree->Branch(pre + "_PZ",        &d->PZ,        pre + "_PZ/F");
+        tree->Branch(pre + "_ETA",       &d->ETA,       pre + "_ETA/f[0,0,14]");
+        tree->Branch(pre + "_PHI",       &d->PHI,       pre + "_PHI/f[0,0,14]");
+        tree->Branch(pre + "_BPVIPCHI2", &d->BPVIPCHI2, pre + "_BPVIPCHI2/f[0,0,10]");
+        tree->Branch(pre + "_GHOSTPROB", &d->GHOSTPROB, pre + "_GHOSTPROB/f[0,1,16]");
+        tree->Branch(pre + "_ID",        &d->ID,        pre + "_ID/S");
+    }
+}
 
 /*
 // OPTIONAL: Function to read ROOT files from directory (not used currently)
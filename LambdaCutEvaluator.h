@@ -0,0 +1,337 @@
+// ============================================================================
+// LambdaCutEvaluator.h
+//
+// Declarative selection for the Lambda-EP matching step (LHCb Pb+Pb 2024).
+//
+// Cuts are read from a plain-text table (default: LambdaCuts.txt), one cut per
+// line in the form
+//
+//     <variable>  <operator>  <threshold>
+//
+// where the cut states what a candidate must satisfy to be kept, the variable
+// is the name of a DecayTree branch bound with AddVariable(), and the operator
+// is one of <, <=, >, >=, ==, != or abs<, abs<= (on the absolute value).
+// Lines starting with '#' are comments. Changing a threshold only needs an
+// edit of the table, no recompilation.
+//
+// Variables bound as event-level (the event multiplicities and PVs) are cut
+// on once per event with BeginEvent(); Pass() reuses that result for every
+// candidate of the event and evaluates only the candidate-level cuts.
+//
+// Two evaluation modes:
+// - kCutFast: stops at the first failed cut. The cuts are periodically
+//   reordered by their measured rejection rate, so that most candidates are
+//   rejected by the first one or two comparisons.
+// - kCutAccounting: evaluates every cut on every candidate and keeps the
+//   per-cut failure counts, the cut flow (in table order) and N-1 counts.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef LambdaCutEvaluator_h
+#define LambdaCutEvaluator_h
+
+#include <Rtypes.h>
+#include <TMath.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+enum LambdaCutMode {
+    kCutAccounting = 0,   // Evaluate all cuts, full cut flow and N-1 counts
+    kCutFast       = 1    // Short-circuit, cuts ordered by rejection rate
+};
+
+// Default selection, used when no cut table is found
+static const char* const kDefaultLambdaCuts =
+    "nBackTracks    >=     10\n"
+    "nVeloTracks    >=     15\n"
+    "nPVs           ==     1\n"
+    "PVZ            abs<=  100\n"
+    "L0_BPVFDCHI2   >=     130\n"
+    "L0_BPVDIRA     >=     0.9999\n"
+    "p_BPVIPCHI2    >=     25\n"
+    "pi_BPVIPCHI2   >=     25\n"
+    "p_PT           >=     500\n"
+    "pi_PT          >=     200\n"
+    "p_GHOSTPROB    <=     0.1\n"
+    "pi_GHOSTPROB   <=     0.1\n";
+
+class LambdaCutEvaluator {
+public:
+    LambdaCutEvaluator()
+        : fMode(kCutAccounting), fNCalls(0), fNextReorder(1024), fNPassed(0), fNEvents(0), fEventPassed(true) {}
+
+    // Bind a variable name to the address its branch is read into; eventLevel
+    // marks variables that are the same for all candidates of an event
+    void AddVariable(const std::string& name, const Int_t* address, bool eventLevel = false)     { AddVariable(name, kInt, address, eventLevel); }
+    void AddVariable(const std::string& name, const UInt_t* address, bool eventLevel = false)    { AddVariable(name, kUInt, address, eventLevel); }
+    void AddVariable(const std::string& name, const Float_t* address, bool eventLevel = false)   { AddVariable(name, kFloat, address, eventLevel); }
+    void AddVariable(const std::string& name, const Double_t* address, bool eventLevel = false)  { AddVariable(name, kDouble, address, eventLevel); }
+    void AddVariable(const std::string& name, const ULong64_t* address, bool eventLevel = false) { AddVariable(name, kULong64, address, eventLevel); }
+
+    // Read the cut table; falls back to kDefaultLambdaCuts if the file is missing
+    bool LoadCuts(const std::string& cutFile) {
+        std::ifstream in(cutFile.c_str());
+        if (!in) {
+            std::cout << "Cut table " << cutFile << " not found, using the default cuts." << std::endl;
+            std::istringstream defaults(kDefaultLambdaCuts);
+            return ParseCuts(defaults, "default cuts");
+        }
+        return ParseCuts(in, cutFile);
+    }
+
+    void SetMode(int mode) { fMode = mode; }
+    int GetMode() const { return fMode; }
+    Long64_t GetNEvents() const { return fNEvents; }
+
+    // True if a cut uses this variable (its branch must be read for every candidate)
+    bool Uses(const std::string& name) const {
+        for (const auto& cut : fCuts)
+            if (fVariables[cut.variable].name == name) return true;
+        return false;
+    }
+
+    // True if the variable was bound as event-level
+    bool IsEventLevel(const std::string& name) const {
+        for (const auto& var : fVariables)
+            if (var.name == name) return var.eventLevel;
+        return false;
+    }
+
+    // Evaluate the event-level cuts for a new event; must be called before
+    // Pass() for the first candidate of every event. In fast mode it stops at
+    // the first failed cut, and the event-level counts are per event.
+    bool BeginEvent() {
+        fNEvents++;
+        fEventPassed = true;
+        for (size_t k : fEventOrder) {
+            Cut& cut = fCuts[k];
+            bool pass = Passes(cut);
+            fEventPass[k] = pass;
+            if (fMode == kCutFast) {
+                cut.nEvaluated++;
+                if (!pass) {
+                    cut.nFailed++;
+                    fEventPassed = false;
+                    break;
+                }
+            }
+            if (!pass) fEventPassed = false;
+        }
+        return fEventPassed;
+    }
+
+    // Evaluate the cuts for the current candidate, with the event-level
+    // results of the last BeginEvent()
+    bool Pass() {
+        fNCalls++;
+        bool pass = (fMode == kCutFast) ? PassFast() : PassAccounting();
+        if (pass) fNPassed++;
+        return pass;
+    }
+
+    // Cut flow, per-cut failures and N-1 counts (accounting mode), or the
+    // measured rejection rates and final order (fast mode)
+    void Print(std::ostream& out) const {
+        if (fMode == kCutFast) {
+            out << "  Event-level cuts (fast mode, per event):\n";
+            for (size_t k : fEventOrder) {
+                const Cut& cut = fCuts[k];
+                out << "    " << std::left << std::setw(26) << Label(cut) << std::right
+                    << ": rejected " << cut.nFailed << " / " << cut.nEvaluated << " evaluated\n";
+            }
+            out << "  Candidate cut order (fast mode, by rejection rate):\n";
+            for (size_t k : fOrder) {
+                const Cut& cut = fCuts[k];
+                out << "    " << std::left << std::setw(26) << Label(cut) << std::right
+                    << ": rejected " << cut.nFailed << " / " << cut.nEvaluated << " evaluated\n";
+            }
+            return;
+        }
+        Long64_t flow = fNCalls;
+        out << "  Cut breakdown (failed | survivors in cut flow | pass N-1):\n";
+        for (size_t k = 0; k < fCuts.size(); ++k) {
+            const Cut& cut = fCuts[k];
+            flow -= cut.nFirstFailed;
+            out << "    " << std::left << std::setw(26) << Label(cut) << std::right
+                << ": " << std::setw(10) << cut.nFailed
+                << " | " << std::setw(10) << flow
+                << " | " << std::setw(10) << fNPassed + cut.nOnlyFailed << "\n";
+        }
+    }
+
+private:
+    enum VarType { kInt, kUInt, kFloat, kDouble, kULong64 };
+    enum CutOp { kLess, kLessEq, kGreater, kGreaterEq, kEqual, kNotEqual, kAbsLess, kAbsLessEq };
+
+    struct Variable {
+        std::string name;
+        VarType     type;
+        const void* address;
+        bool        eventLevel;
+    };
+
+    struct Cut {
+        size_t      variable;       // Index into fVariables
+        CutOp       op;
+        std::string opName;
+        Double_t    threshold;
+        bool        eventLevel;     // Evaluated once per event in BeginEvent()
+        Long64_t    nEvaluated;     // Times the cut was evaluated
+        Long64_t    nFailed;        // Times it rejected the candidate
+        Long64_t    nFirstFailed;   // First failed cut in table order (cut flow)
+        Long64_t    nOnlyFailed;    // The only failed cut (N-1)
+    };
+
+    void AddVariable(const std::string& name, VarType type, const void* address, bool eventLevel) {
+        Variable var;
+        var.name = name;
+        var.type = type;
+        var.address = address;
+        var.eventLevel = eventLevel;
+        fVariables.push_back(var);
+    }
+
+    bool ParseCuts(std::istream& in, const std::string& source) {
+        static const char* opNames[] = {"<", "<=", ">", ">=", "==", "!=", "abs<", "abs<="};
+        fCuts.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string name, opName;
+            Double_t threshold;
+            if (!(fields >> name) || name[0] == '#') continue;
+            if (!(fields >> opName >> threshold)) {
+                std::cerr << "Malformed cut in " << source << ": " << line << std::endl;
+                return false;
+            }
+
+            Cut cut;
+            cut.variable = fVariables.size();
+            for (size_t v = 0; v < fVariables.size(); ++v)
+                if (fVariables[v].name == name) cut.variable = v;
+            if (cut.variable == fVariables.size()) {
+                std::cerr << "Unknown cut variable '" << name << "' in " << source << std::endl;
+                return false;
+            }
+            int op = -1;
+            for (int o = 0; o < 8; ++o)
+                if (opName == opNames[o]) op = o;
+            if (op < 0) {
+                std::cerr << "Unknown cut operator '" << opName << "' in " << source << std::endl;
+                return false;
+            }
+            cut.op = (CutOp)op;
+            cut.opName = opName;
+            cut.threshold = threshold;
+            cut.eventLevel = fVariables[cut.variable].eventLevel;
+            cut.nEvaluated = cut.nFailed = cut.nFirstFailed = cut.nOnlyFailed = 0;
+            fCuts.push_back(cut);
+        }
+        fOrder.clear();
+        fEventOrder.clear();
+        for (size_t k = 0; k < fCuts.size(); ++k)
+            (fCuts[k].eventLevel ? fEventOrder : fOrder).push_back(k);
+        fEventPass.assign(fCuts.size(), 1);
+        std::cout << "Loaded " << fCuts.size() << " cuts from " << source << std::endl;
+        return true;
+    }
+
+    Double_t Value(const Variable& var) const {
+        switch (var.type) {
+            case kInt:     return *(const Int_t*)var.address;
+            case kUInt:    return *(const UInt_t*)var.address;
+            case kFloat:   return *(const Float_t*)var.address;
+            case kDouble:  return *(const Double_t*)var.address;
+            case kULong64: return (Double_t)*(const ULong64_t*)var.address;
+        }
+        return 0;
+    }
+
+    bool Passes(const Cut& cut) const {
+        Double_t x = Value(fVariables[cut.variable]);
+        switch (cut.op) {
+            case kLess:      return x <  cut.threshold;
+            case kLessEq:    return x <= cut.threshold;
+            case kGreater:   return x >  cut.threshold;
+            case kGreaterEq: return x >= cut.threshold;
+            case kEqual:     return x == cut.threshold;
+            case kNotEqual:  return x != cut.threshold;
+            case kAbsLess:   return TMath::Abs(x) <  cut.threshold;
+            case kAbsLessEq: return TMath::Abs(x) <= cut.threshold;
+        }
+        return false;
+    }
+
+    bool PassFast() {
+        // Reorder at the first call past the trigger point, which may have
+        // fallen on a candidate of a rejected event
+        if (fNCalls >= fNextReorder) Reorder();
+        if (!fEventPassed) return false;   // Already counted in BeginEvent()
+        for (size_t k : fOrder) {
+            Cut& cut = fCuts[k];
+            cut.nEvaluated++;
+            if (!Passes(cut)) {
+                cut.nFailed++;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool PassAccounting() {
+        int nFail = 0;
+        size_t lastFail = 0;
+        for (size_t k = 0; k < fCuts.size(); ++k) {
+            Cut& cut = fCuts[k];
+            cut.nEvaluated++;
+            if (cut.eventLevel ? fEventPass[k] : Passes(cut)) continue;
+            cut.nFailed++;
+            if (nFail == 0) cut.nFirstFailed++;
+            lastFail = k;
+            nFail++;
+        }
+        if (nFail == 1) fCuts[lastFail].nOnlyFailed++;
+        return nFail == 0;
+    }
+
+    // Most rejecting candidate-level cut first; the rate is measured on the
+    // candidates that reached each cut. Reordering happens at 1k, 16k, 256k,
+    // ... candidates.
+    void Reorder() {
+        std::stable_sort(fOrder.begin(), fOrder.end(), [this](size_t a, size_t b) {
+            return RejectionRate(fCuts[a]) > RejectionRate(fCuts[b]);
+        });
+        fNextReorder *= 16;
+    }
+
+    static Double_t RejectionRate(const Cut& cut) {
+        return cut.nEvaluated > 0 ? (Double_t)cut.nFailed / cut.nEvaluated : 0.;
+    }
+
+    std::string Label(const Cut& cut) const {
+        std::ostringstream label;
+        label << fVariables[cut.variable].name << " " << cut.opName << " " << cut.threshold;
+        return label.str();
+    }
+
+    int                   fMode;
+    std::vector<Variable> fVariables;
+    std::vector<Cut>      fCuts;        // In table order
+    std::vector<size_t>   fOrder;       // Candidate-level cuts, evaluation order in fast mode
+    std::vector<size_t>   fEventOrder;  // Event-level cuts, table order
+    std::vector<char>     fEventPass;   // Event-level results of the current event
+    Long64_t              fNCalls;
+    Long64_t              fNextReorder;
+    Long64_t              fNPassed;
+    Long64_t              fNEvents;
+    bool                  fEventPassed;
+};
+
+#endif // LambdaCutEvaluator_h
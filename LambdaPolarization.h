@@ -0,0 +1,246 @@
+// ============================================================================
+// LambdaPolarization.h
+//
+// Global-polarization stage of the Lambda-EP matching step (LHCb Pb+Pb 2024).
+//
+// For every saved candidate the proton direction is computed in the Lambda
+// rest frame and projected on the direction of the global angular momentum,
+// taken perpendicular to the first-order event plane:
+//
+//     L = (sin Psi1, -cos Psi1, 0),     cos theta* = p*_proton . L / |p*_proton|
+//
+// Candidates are collected in fixed-size blocks of plain arrays (structure of
+// arrays). The boost loop over a block has no branches, no calls other than
+// sqrt (L is stored as its components) and no allocations, so the compiler
+// vectorizes it as long as sqrt does not set errno (clang on macOS by
+// default, gcc with -fno-math-errno). The block and the (centrality,
+// cos theta*, mass) counts are allocated once per file, and the counts are
+// written as a TH3D at the end of the file.
+//
+// For the invariant-mass fits (GlobalPolarizationFits.C) the candidates are
+// also counted in mass histograms per (centrality, DeltaPhi, pT) bin, with
+// DeltaPhi = Psi1 - phi*_p the azimuth of the rest-frame proton relative to
+// the EP, together with the sums of the resolution term r1 per centrality.
+// All outputs are plain histograms, so files can be merged with hadd.
+//
+// Momenta and masses are in MeV, as in the DecayTree.
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#ifndef LambdaPolarization_h
+#define LambdaPolarization_h
+
+#include <Rtypes.h>
+#include <TH1D.h>
+#include <TH3D.h>
+#include <TDirectory.h>
+#include <TMath.h>
+#include <TString.h>
+#include <cmath>
+#include <vector>
+
+const Int_t    kPolBlockSize = 256;          // Candidates per kernel call
+const Double_t kProtonMass   = 938.272;      // MeV
+
+// Centrality bins in nVeloTracks, same as in calculateEventPlane.cpp:
+// bin k covers (edge[k], edge[k+1]]
+const Int_t    kNPolCentBins = 3;
+static const Double_t kPolCentralityEdges[kNPolCentBins + 1] = {14, 126, 270, 2000};
+
+// DeltaPhi bins on [0, 2pi) and Lambda pT bins (MeV) of the mass histograms
+const Int_t    kNPolDPhiBins = 8;
+const Int_t    kNPolPtBins   = 6;
+static const Double_t kPolPtEdges[kNPolPtBins + 1] = {0, 1000, 1500, 2000, 3000, 5000, 10000};
+
+// Mass axis of all histograms (MeV)
+const Int_t    kNPolMassBins = 90;
+const Double_t kPolMassMin   = 1093.;
+const Double_t kPolMassMax   = 1138.;
+
+// Name of the mass histogram of one (centrality, DeltaPhi, pT) bin in the "MassBins" directory
+inline TString PolMassBinName(Int_t cent, Int_t dPhi, Int_t pt) {
+    return TString::Format("hMass_c%d_dphi%d_pt%d", cent, dPhi, pt);
+}
+
+// ============================================================================
+// Block of candidates, structure of arrays
+// ============================================================================
+struct PolarizationBlock {
+    Int_t    n;
+    Double_t L0_PX[kPolBlockSize], L0_PY[kPolBlockSize], L0_PZ[kPolBlockSize], L0_MASS[kPolBlockSize];
+    Double_t p_PX[kPolBlockSize], p_PY[kPolBlockSize], p_PZ[kPolBlockSize];
+    Double_t Lx[kPolBlockSize], Ly[kPolBlockSize];   // L direction, from Psi1
+    Double_t nVeloTracks[kPolBlockSize];
+    Double_t r1[kPolBlockSize];
+
+    // Output of ComputeCosThetaStar()
+    Double_t cosThetaStar[kPolBlockSize];
+    Double_t sinDPhi[kPolBlockSize], cosDPhi[kPolBlockSize];   // DeltaPhi = Psi1 - phi*_p
+    Double_t L0_PT[kPolBlockSize];
+};
+
+// Boost the protons of the block into their Lambda rest frame and project on L.
+// With beta = p_L / E_L and gamma = E_L / m_L, the rest-frame momentum is
+//     p* = p + beta * (gamma^2 / (gamma + 1) * (beta . p) - gamma * E_p)
+// With L = (sin Psi1, -cos Psi1), sin(Psi1 - phi*) = (L . p*_T) / |p*_T| and
+// cos(Psi1 - phi*) = (L x p*_T)_z / |p*_T|.
+inline void ComputeCosThetaStar(PolarizationBlock& b) {
+    const Int_t n = b.n;
+    for (Int_t i = 0; i < n; ++i) {
+        Double_t lpx = b.L0_PX[i], lpy = b.L0_PY[i], lpz = b.L0_PZ[i], lm = b.L0_MASS[i];
+        Double_t ppx = b.p_PX[i], ppy = b.p_PY[i], ppz = b.p_PZ[i];
+
+        Double_t lE  = std::sqrt(lpx * lpx + lpy * lpy + lpz * lpz + lm * lm);
+        Double_t pE  = std::sqrt(ppx * ppx + ppy * ppy + ppz * ppz + kProtonMass * kProtonMass);
+        Double_t bx = lpx / lE, by = lpy / lE, bz = lpz / lE;
+        Double_t gamma = lE / lm;
+        Double_t bp = bx * ppx + by * ppy + bz * ppz;
+        Double_t k = gamma * gamma / (gamma + 1.) * bp - gamma * pE;
+
+        Double_t sx = ppx + k * bx, sy = ppy + k * by, sz = ppz + k * bz;
+        Double_t ptStar = std::sqrt(sx * sx + sy * sy);
+        Double_t norm = std::sqrt(sx * sx + sy * sy + sz * sz);
+        Double_t proj = sx * b.Lx[i] + sy * b.Ly[i];
+        b.cosThetaStar[i] = proj / norm;
+        b.sinDPhi[i] = proj / ptStar;
+        b.cosDPhi[i] = (b.Lx[i] * sy - b.Ly[i] * sx) / ptStar;
+        b.L0_PT[i] = std::sqrt(lpx * lpx + lpy * lpy);
+    }
+}
+
+// ============================================================================
+// PolarizationAccumulator
+// ============================================================================
+// Counts in (centrality, cos theta*, mass) with the TH3D bin layout
+// (underflow and overflow included) and in the (centrality, DeltaPhi, pT)
+// mass histograms, filled block by block.
+class PolarizationAccumulator {
+public:
+    PolarizationAccumulator(Int_t nCosBins = 20, Int_t nMassBins = kNPolMassBins, Double_t massMin = kPolMassMin,
+                            Double_t massMax = kPolMassMax)
+        : fNCos(nCosBins), fNMass(nMassBins), fMassMin(massMin), fMassMax(massMax), fNFilled(0),
+          fCounts((kNPolCentBins + 2) * (nCosBins + 2) * (nMassBins + 2), 0.),
+          fMassBinCounts(kNPolCentBins * kNPolDPhiBins * kNPolPtBins * (nMassBins + 2), 0.),
+          fR1Sum(kNPolCentBins, 0.), fR1Sum2(kNPolCentBins, 0.), fR1Count(kNPolCentBins, 0.) {
+        fBlock.n = 0;
+    }
+
+    // Queue one candidate; the block is processed when full
+    void Add(Double_t L0_PX, Double_t L0_PY, Double_t L0_PZ, Double_t L0_MASS,
+             Double_t p_PX, Double_t p_PY, Double_t p_PZ, Double_t Psi1, Double_t r1, Int_t nVeloTracks) {
+        Int_t i = fBlock.n++;
+        fBlock.L0_PX[i] = L0_PX;  fBlock.L0_PY[i] = L0_PY;  fBlock.L0_PZ[i] = L0_PZ;  fBlock.L0_MASS[i] = L0_MASS;
+        fBlock.p_PX[i] = p_PX;    fBlock.p_PY[i] = p_PY;    fBlock.p_PZ[i] = p_PZ;
+        fBlock.Lx[i] = std::sin(Psi1);
+        fBlock.Ly[i] = -std::cos(Psi1);
+        fBlock.nVeloTracks[i] = nVeloTracks;
+        fBlock.r1[i] = r1;
+        if (fBlock.n == kPolBlockSize) Flush();
+    }
+
+    // Process the queued candidates
+    void Flush() {
+        if (fBlock.n == 0) return;
+        ComputeCosThetaStar(fBlock);
+        const Double_t cosScale = fNCos / 2.;
+        const Double_t massScale = fNMass / (fMassMax - fMassMin);
+        for (Int_t i = 0; i < fBlock.n; ++i) {
+            Int_t cent = 0;
+            for (Int_t k = 0; k <= kNPolCentBins; ++k) cent += fBlock.nVeloTracks[i] > kPolCentralityEdges[k];
+            Int_t iCos = Bin((fBlock.cosThetaStar[i] + 1.) * cosScale, fNCos);
+            Int_t iMass = Bin((fBlock.L0_MASS[i] - fMassMin) * massScale, fNMass);
+            fCounts[(iMass * (fNCos + 2) + iCos) * (kNPolCentBins + 2) + cent] += 1.;
+
+            // Mass histograms and resolution sums: only inside the centrality and pT ranges
+            Int_t pt = -1;
+            for (Int_t k = 0; k <= kNPolPtBins; ++k) pt += fBlock.L0_PT[i] >= kPolPtEdges[k];
+            if (cent < 1 || cent > kNPolCentBins || pt < 0 || pt >= kNPolPtBins) continue;
+            Double_t dPhi = TMath::ATan2(fBlock.sinDPhi[i], fBlock.cosDPhi[i]);
+            if (dPhi < 0) dPhi += TMath::TwoPi();
+            Int_t iDPhi = TMath::Min((Int_t)(dPhi / TMath::TwoPi() * kNPolDPhiBins), kNPolDPhiBins - 1);
+            fMassBinCounts[MassBinIndex(cent - 1, iDPhi, pt) * (fNMass + 2) + iMass] += 1.;
+            fR1Sum[cent - 1]   += fBlock.r1[i];
+            fR1Sum2[cent - 1]  += fBlock.r1[i] * fBlock.r1[i];
+            fR1Count[cent - 1] += 1.;
+        }
+        fNFilled += fBlock.n;
+        fBlock.n = 0;
+    }
+
+    Long64_t GetNFilled() const { return fNFilled; }
+
+    // Histogram of the counts; x = nVeloTracks (centrality bins), y = cos theta*, z = mass
+    TH3D* MakeHistogram(const char* name) const {
+        std::vector<Double_t> cosEdges(fNCos + 1), massEdges(fNMass + 1);
+        for (Int_t k = 0; k <= fNCos; ++k) cosEdges[k] = -1. + 2. * k / fNCos;
+        for (Int_t k = 0; k <= fNMass; ++k) massEdges[k] = fMassMin + (fMassMax - fMassMin) * k / fNMass;
+        TH3D* h = new TH3D(name, "#Lambda candidates;nVeloTracks;cos#theta*;M(p#pi) [MeV]",
+                           kNPolCentBins, kPolCentralityEdges, fNCos, cosEdges.data(), fNMass, massEdges.data());
+        for (Int_t iMass = 0; iMass < fNMass + 2; ++iMass)
+            for (Int_t iCos = 0; iCos < fNCos + 2; ++iCos)
+                for (Int_t cent = 0; cent < kNPolCentBins + 2; ++cent) {
+                    Double_t count = fCounts[(iMass * (fNCos + 2) + iCos) * (kNPolCentBins + 2) + cent];
+                    h->SetBinContent(cent, iCos, iMass, count);
+                }
+        h->SetEntries(fNFilled);
+        return h;
+    }
+
+    // Write the mass histograms into dir/MassBins and the r1 sums per
+    // centrality bin (hR1Sum: content sum r1, error sqrt(sum r1^2); hR1Count)
+    void WriteMassBins(TDirectory* dir) const {
+        TDirectory* massDir = dir->mkdir("MassBins");
+        massDir->cd();
+        for (Int_t cent = 0; cent < kNPolCentBins; ++cent)
+            for (Int_t dPhi = 0; dPhi < kNPolDPhiBins; ++dPhi)
+                for (Int_t pt = 0; pt < kNPolPtBins; ++pt) {
+                    TString name = PolMassBinName(cent, dPhi, pt);
+                    TH1D h(name, TString::Format("cent %d, #Delta#Phi bin %d, p_{T} %g-%g MeV;M(p#pi) [MeV];Candidates",
+                                                 cent, dPhi, kPolPtEdges[pt], kPolPtEdges[pt + 1]),
+                           fNMass, fMassMin, fMassMax);
+                    const Double_t* counts = &fMassBinCounts[MassBinIndex(cent, dPhi, pt) * (fNMass + 2)];
+                    Double_t entries = 0;
+                    for (Int_t iMass = 0; iMass < fNMass + 2; ++iMass) {
+                        h.SetBinContent(iMass, counts[iMass]);
+                        h.SetBinError(iMass, TMath::Sqrt(counts[iMass]));
+                        entries += counts[iMass];
+                    }
+                    h.SetEntries(entries);
+                    h.Write();
+                }
+        dir->cd();
+        TH1D hSum("hR1Sum", "Sum of r1 per centrality bin;nVeloTracks;#Sigma r_{1}", kNPolCentBins, kPolCentralityEdges);
+        TH1D hCount("hR1Count", "Candidates per centrality bin;nVeloTracks;N", kNPolCentBins, kPolCentralityEdges);
+        for (Int_t cent = 0; cent < kNPolCentBins; ++cent) {
+            hSum.SetBinContent(cent + 1, fR1Sum[cent]);
+            hSum.SetBinError(cent + 1, TMath::Sqrt(fR1Sum2[cent]));
+            hCount.SetBinContent(cent + 1, fR1Count[cent]);
+        }
+        hSum.Write();
+        hCount.Write();
+    }
+
+private:
+    static Int_t MassBinIndex(Int_t cent, Int_t dPhi, Int_t pt) {
+        return (cent * kNPolDPhiBins + dPhi) * kNPolPtBins + pt;
+    }
+
+    // Bin index with underflow (0) and overflow (nBins + 1) for x in units of bins
+    static Int_t Bin(Double_t x, Int_t nBins) {
+        if (!(x >= 0.)) return 0;            // Also catches NaN
+        if (x >= nBins) return nBins + 1;
+        return (Int_t)x + 1;
+    }
+
+    Int_t                 fNCos, fNMass;
+    Double_t              fMassMin, fMassMax;
+    Long64_t              fNFilled;
+    PolarizationBlock     fBlock;
+    std::vector<Double_t> fCounts;
+    std::vector<Double_t> fMassBinCounts;   // [cent][dPhi][pt][mass incl. under/overflow]
+    std::vector<Double_t> fR1Sum, fR1Sum2, fR1Count;
+};
+
+#endif // LambdaPolarization_h
@@ -4,6 +4,9 @@
 // Author: Maria Stefaniak, The Ohio State University
 // Description: Applies centering and shifting corrections to 
 //              calculate final Event Plane angles and resolution.
+//              The corrections themselves are in EventPlaneCalculator.h,
+//              shared with the matching step; the input (QVectorEvent) and
+//              output (EventPlane) classes are in EPDataModel.h.
 //////////////////////////////////////////////////////////////
 
 #include <TChain.h>
@@ -17,95 +20,18 @@
 #include <TCanvas.h>
 #include <iostream>
 
+#include "EPDataModel.h"
+#include "EventPlaneCalculator.h"
+#include "EPTrace.h"
 
 double pi = TMath::Pi();
 
-
-class Event {
-    public:
-        ULong64_t       outGPSTIME;
-        ULong64_t       outEVENTNUMBER;
-        Float_t         outPVX;   
-        Float_t         outPVY;  
-        Float_t         outPVZ;  
-        UInt_t          outRUNNUMBER;
-        Int_t           outnBackTracks;
-        Int_t           outnVeloClusters;
-        Int_t           outnVeloTracks;
-        Int_t           outnEcalClusters;
-
-        Int_t           outECalETot;
-        Int_t           outnLongTracks;
-        Int_t           outnVPClusters;
-
-
-        Double_t        outQx_back[2];
-        Double_t        outQy_back[2];
-        Double_t        outQx_for[2][4];
-        Double_t        outQy_for[2][4];
-
-        Double_t        outQx_back_wEta[2];
-        Double_t        outQy_back_wEta[2];
-        Double_t        outQx_for_wEta[2][4];
-        Double_t        outQy_for_wEta[2][4];
-
-
-        Int_t           out_Qmulti[4];
-    
-        Event() : outGPSTIME(0), outEVENTNUMBER(0), outRUNNUMBER(0){}
-    };
-
-class EventPlane {
-    public:
-        ULong64_t       EVENTNUMBER;
-        UInt_t          RUNNUMBER;
-        Double_t        Psi1Full;
-        Double_t        Psi2Full;
-        Double_t        PsiBack[2];
-        Double_t        PsiFor[2];
-        Double_t        r1;
-        Double_t        r2;          
-
-        EventPlane() :  EVENTNUMBER(0), RUNNUMBER(0){}
-    };
-
-         
-double makeShift(double psi, TH2D *hShiftSin, TH2D *hShiftCos, int iep, int n){
-     
-    double PsiShifted=psi;
-    for(int j = 1; j < 9; j++)  PsiShifted += (2.0/(float)j) * (- hShiftSin->GetBinContent(iep+1, j)*cos(j*n*psi)+ hShiftCos->GetBinContent(iep+1, j)*sin(j*n*psi)) / n;
-    return PsiShifted;
-}
-     
-double keepPsiInPi(double psi){
-   
-    double psiNew = psi;
-    if(abs(psi) < pi) psiNew = psi;
-    else{
-       if(psi < 0) psiNew = 2*pi - psi;
-       if(psi > 0) psiNew = psi - 2*pi;
-    }
-    return psiNew;
-}
-double keepPsiInHalfPi(double psi){
-
-    double psiNew = psi;
-    if(abs(psi) < 0.5*pi) psiNew = psi;
-    else{
-        if(psi < 0) psiNew = pi + psi;
-        if(psi > 0) psiNew = psi - pi;
-    }
-    return psiNew;
-}
-
 void calculateEventPlane(int EP_correction=1){
 
     cout << "EP_correction "<< EP_correction << endl;
     const int nrCentBins = 3;
-// Define centrality bins based on number of VELO tracks (nVeloTracks)
-    int CentralityBins[nrCentBins+1] = {14  , 126 ,   270 ,  2000};//350};
-   // int CentralityBins[nrCentBins+1] = {400 ,  500,  600, 700};
-   // int CentralityBins[nrCentBins+1] = {14, 200, 10000};
+// Centrality bins based on number of VELO tracks (nVeloTracks): {14, 126, 270, 2000},
+// see EventPlaneCalculator::CentralityBin
 
 // Input ROOT file containing Q vectors from VELO tracks
     TFile* file = TFile::Open("/Users/stefaniak.9/OneDriveOSU/LHCb_Maria/EventPlane/PbPb2024_VELO/output/event_plane_pbpb_fulleta_weq1.root"); //centTests/weights_event_plane_pbpb_localtest.root");//
@@ -120,7 +46,7 @@ void calculateEventPlane(int EP_correction=1){
         return;
     }
       // Set up pointer to the Event object in the tree
-    Event* evt = nullptr;
+    QVectorEvent* evt = nullptr;
     tree->SetBranchAddress("event", &evt);
 
     // Create output file and tree
@@ -191,104 +117,50 @@ void calculateEventPlane(int EP_correction=1){
     double Resolution2[3] = {0,0,0};
     int nrR[4] = {0,0,0};
 
-
-     // QxQy centering:
-    double Qxmean_back[2][nrCentBins], Qxmean_for[2][nrCentBins], Qxmean_full[2][nrCentBins]; 
-    double Qymean_back[2][nrCentBins], Qymean_for[2][nrCentBins], Qymean_full[2][nrCentBins]; 
-    TH2D *hQxQy_back_corr[2][nrCentBins], *hQxQy_for_corr[2][nrCentBins], *hQxQy_full_corr[2][nrCentBins]; 
-    TProfile2D *hEPshift_sinIN[nrCentBins], *hEPshift_cosIN[nrCentBins];
-
+    // QxQy centering and shifting from the previous pass:
+    EventPlaneCalculator calc(iEta);
     if(EP_correction > 1){
 // Open file with previously calculated Q-vector centering weights
-        TFile *fWeights = new TFile("EP_PbPb2024_weights_test.root", "READ");
-
-        for(int iCent = 0; iCent < nrCentBins; iCent++){
-            for(int in = 0; in < 2; in++){
-                hQxQy_back_corr[in][iCent]  = (TH2D*)fWeights->Get(Form("hQxQy_back_n%d_cent%d",in, iCent));
-                Qxmean_back[in][iCent]      = hQxQy_back_corr[in][iCent]->GetMean(1);
-                Qymean_back[in][iCent]      = hQxQy_back_corr[in][iCent]->GetMean(2);
-
-                hQxQy_for_corr[in][iCent] = (TH2D*)fWeights->Get(Form("hQxQy_for_n%d_cent%d_Eta%d",in,iCent, iEta));
-                Qxmean_for[in][iCent]           = hQxQy_for_corr[in][iCent]->GetMean(1);
-                Qymean_for[in][iCent]           = hQxQy_for_corr[in][iCent]->GetMean(2);
-
-                hQxQy_full_corr[in][iCent] = (TH2D*)fWeights->Get(Form("hQxQy_full_n%d_cent%d_Eta%d",in,iCent, iEta));
-                Qxmean_full[in][iCent]           = hQxQy_full_corr[in][iCent]->GetMean(1);
-                Qymean_full[in][iCent]           = hQxQy_full_corr[in][iCent]->GetMean(2);
-            }
-        }
-
-            // shifting:
-        
-        for(int iCent = 0; iCent < nrCentBins; iCent++){
-                hEPshift_sinIN[iCent] = (TProfile2D*)fWeights->Get(Form("hEPshift_sin_cent%d",iCent));
-                hEPshift_cosIN[iCent] = (TProfile2D*)fWeights->Get(Form("hEPshift_cos_cent%d",iCent));
-        }
-        
+        if(!calc.Load("EP_PbPb2024_weights_test.root")) return;
     }
     // Fill histogram
     Long64_t nEntries = tree->GetEntries();
     cout << "nEntries " << nEntries << endl;
+    EPTrace& trace = EPTrace::Instance();
+    Long64_t passBegin = trace.Now();
     for (Long64_t i = 0; i < nEntries; ++i) {
         tree->GetEntry(i);
         if (evt->outRUNNUMBER ==   310318 && evt->outEVENTNUMBER == 93971618) cout << "93971618 " <<  endl;
-        if(evt->outnVeloTracks > 1000 && evt->outnEcalClusters < 480) continue;
+        if(!EventPlaneCalculator::AcceptEvent(evt->outnVeloTracks, evt->outnEcalClusters)) continue;
 
         hCentrality->Fill(evt->outnVeloTracks);
         hVeloClusters_EcalClusters->Fill(evt->outnVeloTracks, evt->outnEcalClusters);
         hVPClusters_EcalClusters->Fill(evt->outnVPClusters, evt->outnEcalClusters);
         hnVeloTracks_outECalETot->Fill(evt->outnVeloTracks, evt->outECalETot);
-// Eta sign flip: forward v1 is negative, backward is positive
-        int a = -1; int b = 1;  // as the w for Q vectors are equal to 1, we can here modify if we want to same sign or opposite for weights
-        int CentBin = 2;
+// Eta sign flip: forward v1 is negative, backward is positive (applied in EventPlaneCalculator::RawQVectors)
+        int a = -1;  // for the test vectors of the other forward eta bins below
         // Centrality:
-        for(int iCent = 0; iCent < nrCentBins; iCent++){
-            if(evt->outnVeloTracks > CentralityBins[iCent] && evt->outnVeloTracks <= CentralityBins[iCent+1]) 
-                CentBin = iCent;
+        int CentBin = EventPlaneCalculator::CentralityBin(evt->outnVeloTracks);
+        // Q-vectors (w = 1) of backward, forward (iEta bin) and full side, [n-1][side]
+        EPQVectors q;
+        q.nVeloTracks = evt->outnVeloTracks;
+        q.nEcalClusters = evt->outnEcalClusters;
+        for(int in = 0; in <2; in++){
+            q.Qx_back[in] = evt->outQx_back[in];    q.Qy_back[in] = evt->outQy_back[in];
+            for(int ie = 0; ie < 4; ie++){ q.Qx_for[in][ie] = evt->outQx_for[in][ie];  q.Qy_for[in][ie] = evt->outQy_for[in][ie]; }
         }
-        double Qx_back[2],  Qy_back[2], Qx_for[2], Qy_for[2]; // 0: n = 1, and 1: n=2, for forward the iEta will determine which bin we take
-        double Qx_full[2],  Qy_full[2]; // for final Psi determination
-        double Psi_back[2], Psi_for[2], Psi_full[2]; 
-        //set everything to 0:
-        for(int in = 0; in <2; in++){Qx_back[in] = 0; Qy_back[in] = 0; Qx_for[in] = 0; Qy_for[in] = 0;  Qx_full[in] = 0; Qy_full[in] = 0;}
-        // n = 1:
-        // w = eta
-      //  Qx_back[0] =  b*evt->outQx_back_wEta[0];           Qy_back[0] =  b*evt->outQy_back_wEta[0]; 
-      //  Qx_for[0]  =  a*evt->outQx_for_wEta[0][iEta];      Qy_for[0]  =  a*evt->outQy_for_wEta[0][iEta];
-
-      //w = 1
-        Qx_back[0] =  b*evt->outQx_back[0];           Qy_back[0] =  b*evt->outQy_back[0]; 
-        Qx_for[0]  =  a*evt->outQx_for[0][iEta];      Qy_for[0]  =  a*evt->outQy_for[0][iEta];
-
-
-        Qx_full[0] =  Qx_back[0] + Qx_for[0];         Qy_full[0] =  Qy_back[0] +  Qy_for[0];
-        // n = 2:
-        Qx_back[1] =  evt->outQx_back[1];             Qy_back[1] = evt->outQy_back[1];
-        Qx_for[1]  =  evt->outQx_for[1][iEta];        Qy_for[1]  = evt->outQy_for[1][iEta];
-        Qx_full[1] =  Qx_back[1] + Qx_for[1];         Qy_full[1] = Qy_back[1] + Qy_for[1];
-        
+        double Qx[2][EventPlaneCalculator::kNSides], Qy[2][EventPlaneCalculator::kNSides];
+        double Psi[2][EventPlaneCalculator::kNSides];
+        calc.RawQVectors(q, Qx, Qy);
 
-        hQxQy_back[0][CentBin] -> Fill(Qx_back[0], Qy_back[0]);
-        hQxQy_back[1][CentBin] -> Fill(Qx_back[1], Qy_back[1]);
- 
-        hQxQy_for[0][CentBin] -> Fill(Qx_for[0], Qy_for[0]);
-        hQxQy_for[1][CentBin] -> Fill(Qx_for[1], Qy_for[1]);
- 
-        hQxQy_full[0][CentBin] -> Fill(Qx_full[0], Qy_full[0]);
-        hQxQy_full[1][CentBin] -> Fill(Qx_full[1], Qy_full[1]);
- 
-
-        if(EP_correction<2) continue;
         for(int in = 0; in <2; in++){
-            Qx_back[in] -= Qxmean_back[in][CentBin];
-            Qy_back[in] -= Qymean_back[in][CentBin];
-
-            Qx_for[in]  -= Qxmean_for[in][CentBin];
-            Qy_for[in]  -= Qymean_for[in][CentBin];
-
-            Qx_full[in] -= Qxmean_full[in][CentBin];
-            Qy_full[in] -= Qymean_full[in][CentBin];
+            hQxQy_back[in][CentBin] -> Fill(Qx[in][kEPBack], Qy[in][kEPBack]);
+            hQxQy_for[in][CentBin]  -> Fill(Qx[in][kEPFor],  Qy[in][kEPFor]);
+            hQxQy_full[in][CentBin] -> Fill(Qx[in][kEPFull], Qy[in][kEPFull]);
         }
+
+        if(EP_correction<2) continue;
+        calc.Recenter(CentBin, Qx, Qy);
        // =====================================
 
 
@@ -300,10 +172,10 @@ void calculateEventPlane(int EP_correction=1){
         TVector2 Q3(a*evt->outQx_for[order][2], a*evt->outQy_for[order][2]);
         TVector2 Qback(b*evt->outQx_back[order], b*evt->outQy_back[order]);*/
 
-        TVector2 Q1(Qx_for[0], Qy_for[0]);
+        TVector2 Q1(Qx[0][kEPFor], Qy[0][kEPFor]);
         TVector2 Q2(a*evt->outQx_for[order][1], a*evt->outQy_for[order][1]);
         TVector2 Q3(a*evt->outQx_for[order][2], a*evt->outQy_for[order][2]);
-        TVector2 Qback(Qx_back[0], Qy_back[0]);
+        TVector2 Qback(Qx[0][kEPBack], Qy[0][kEPBack]);
 
         Q1 = Q1.Unit();
         Q2 = Q2.Unit();
@@ -317,29 +189,10 @@ void calculateEventPlane(int EP_correction=1){
         hQdotQback[1][CentBin] -> Fill(Q2*Qback);
         hQdotQback[2][CentBin] -> Fill(Q3*Qback);
 
-        // =====================================
-        // fliiping signes:
-     //   Qx_back[0] *= (-1); /// backward needs to be positive
-     //   Qy_back[0] *= (-1);
-
-      //  Qx_for[0] *= (-1); /// forward negative
-      //  Qy_for[0] *= (-1);
-
-     //   Qx_full[0] *= (-1); /// if I flip both signes I can do the full also with * (-1)
-    //    Qy_full[0] *= (-1);
-
-        // end of flipping signes
-
-        Psi_back[0] = atan2(Qy_back[0], Qx_back[0]);
-        Psi_for[0]  = atan2(Qy_for[0],  Qx_for[0]) ;
-        Psi_full[0] = atan2(Qy_full[0], Qx_full[0]);
-
-        Psi_back[1] = atan2(Qy_back[1], Qx_back[1]) * 0.5;
-        Psi_for[1]  = atan2(Qy_for[1],  Qx_for[1])  * 0.5;
-        Psi_full[1] = atan2(Qy_full[1], Qx_full[1]) * 0.5;
+        EventPlaneCalculator::Angles(Qx, Qy, Psi);
 
 
-        double FullPsi[6] = {Psi_back[0], Psi_for[0], Psi_full[0], Psi_back[1], Psi_for[1], Psi_full[1]};
+        double FullPsi[6] = {Psi[0][kEPBack], Psi[0][kEPFor], Psi[0][kEPFull], Psi[1][kEPBack], Psi[1][kEPFor], Psi[1][kEPFull]};
         for(int j = 1; j < 9; j++){
             for(int iep = 0; iep < 3; iep++){
                hEPshift_sin[CentBin] -> Fill(iep, j, sin(j*FullPsi[iep]));
@@ -351,23 +204,14 @@ void calculateEventPlane(int EP_correction=1){
             }
          }
         if(EP_correction<3) continue; 
-        // shift Psi:
+        // shift Psi and keep Psi1 in [-pi, pi], Psi2 in [-pi/2, pi/2]:
         double PsiFullShifted[6] = {0,0,0,0,0,0};
-        if(EP_correction==3){
-            for(int iep = 0; iep < 3; iep++){
-                PsiFullShifted[iep] = makeShift(FullPsi[iep], hEPshift_sinIN[CentBin], hEPshift_cosIN[CentBin], iep, 1 );
-            }
-            for(int iep = 3; iep < 6; iep++){
-                PsiFullShifted[iep] = makeShift(FullPsi[iep], hEPshift_sinIN[CentBin], hEPshift_cosIN[CentBin], iep, 2 );
-            }
+        for(int iep = 0; iep < 6; iep++){
+            int in = iep / 3;
+            PsiFullShifted[iep] = calc.Shift(CentBin, in, iep % 3, FullPsi[iep]);
+            PsiFullShifted[iep] = (in == 0) ? EventPlaneCalculator::WrapPsi1(PsiFullShifted[iep])
+                                            : EventPlaneCalculator::WrapPsi2(PsiFullShifted[iep]);
         }
-        PsiFullShifted[0] = keepPsiInPi(PsiFullShifted[0]); //backward psi 1
-        PsiFullShifted[1] = keepPsiInPi(PsiFullShifted[1]); //forward psi 1
-        PsiFullShifted[2] = keepPsiInPi(PsiFullShifted[2]); //full psi 1
-        
-        PsiFullShifted[3] = keepPsiInHalfPi(PsiFullShifted[3]); //backward psi 2
-        PsiFullShifted[4] = keepPsiInHalfPi(PsiFullShifted[4]); //forward psi 2
-        PsiFullShifted[5] = keepPsiInHalfPi(PsiFullShifted[5]); //full psi 2
 
         /*hPsi_back[0][CentBin]->Fill(FullPsi[0]);
         hPsi_back[1][CentBin]->Fill(FullPsi[3]);
@@ -415,6 +259,7 @@ void calculateEventPlane(int EP_correction=1){
         outTree->Fill(); 
         
     }//End of loop over Events
+    if (trace.IsEnabled()) trace.Complete(Form("EP pass %d", EP_correction), "step2", passBegin, trace.Now(), "");
     
     for(int iCent = 0; iCent <nrCentBins; iCent++){
         Resolution1[iCent] = sqrt(2*Resolution1[iCent]/nrR[iCent]) *100;
@@ -426,6 +271,7 @@ void calculateEventPlane(int EP_correction=1){
 
     if(EP_correction<3){
 // Create file to store centering/shifting histograms for corrections
+        EPTraceScope weightsTrace("write EP weights", "io", "EP_PbPb2024_weights_test.root");
         TFile *weightsFile = new TFile("EP_PbPb2024_weights_test.root", "RECREATE");
         for(int iCent = 0; iCent <nrCentBins; iCent++){
 
@@ -548,6 +394,7 @@ void calculateEventPlane(int EP_correction=1){
 
 
     // Save and close
+    EPTraceScope writeTrace("write EP file", "io");
     outFile->cd();
     outTree->Write();
     outFile->Close();
@@ -0,0 +1,101 @@
+// ============================================================================
+// ep-calibrate
+//
+// Step 2 as a standalone executable: recentering and shift calibration of
+// step-1 Q-vector tuples and the EP file of the calibrated angles. Runs the
+// passes of calculateEventPlane (1), (2) and (3) in one job, in memory
+// (EPCalibrationStore of EventPlaneCalculator.h).
+//
+// Usage:
+//   ep-calibrate [-e etaBin] [-w weights.root] [-o eventplane.root] [-i] <Q-vector file> [...]
+//
+// The weights file holds the same histograms as that of calculateEventPlane,
+// the EP file the same EventPlaneTuple. Built by the Makefile; set
+// EP_TRACE=trace.json to record a timeline (EPTrace.h).
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#include "EPDataModel.h"
+#include "EventPlaneCalculator.h"
+#include "EPMatchIndex.h"
+
+#include <TStopwatch.h>
+#include <getopt.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [-e etaBin] [-w weights.root] [-o eventplane.root] [-i] <Q-vector file> [...]\n"
+              << "  -e, --eta-bin N     forward eta bin of the EP (1-3, default 1)\n"
+              << "  -w, --weights FILE  weights file to write (default EP_PbPb2024_weights.root)\n"
+              << "  -o, --output FILE   EP file to write (default EP_PbPb2024_calculated.root)\n"
+              << "  -i, --index         also build the EP index sidecar (<EP file>.idx) for ep-match\n"
+              << "  -h, --help          print this help" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int etaBin = 1;
+    std::string weightsName = "EP_PbPb2024_weights.root";
+    std::string EPfileName = "EP_PbPb2024_calculated.root";
+    bool buildSidecar = false;
+
+    static struct option longOptions[] = {
+        {"eta-bin", required_argument, nullptr, 'e'},
+        {"weights", required_argument, nullptr, 'w'},
+        {"output",  required_argument, nullptr, 'o'},
+        {"index",   no_argument,       nullptr, 'i'},
+        {"help",    no_argument,       nullptr, 'h'},
+        {nullptr,   0,                 nullptr, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "e:w:o:ih", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'e': etaBin = std::atoi(optarg); break;
+            case 'w': weightsName = optarg; break;
+            case 'o': EPfileName = optarg; break;
+            case 'i': buildSidecar = true; break;
+            case 'h': PrintUsage(argv[0]); return 0;
+            default:  PrintUsage(argv[0]); return 1;
+        }
+    }
+    if (optind == argc || etaBin < 1 || etaBin > 3) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // Pass 0: read the Q-vectors of all files into memory
+    TStopwatch timer;
+    EPCalibrationStore store(etaBin);
+    Long64_t nEvents = 0;
+    for (int i = optind; i < argc; ++i) {
+        bool ok = ForEachQVectorEvent(argv[i], [&](Long64_t, UInt_t run, ULong64_t event, const EPQVectors& q) {
+            nEvents++;
+            store.Add(run, event, q);
+        });
+        if (!ok) return 1;
+    }
+    std::cout << "Read " << nEvents << " events from " << argc - optind << " Q-vector files, "
+              << store.GetN() << " accepted for the EP" << std::endl;
+
+    // Passes 1-3: recentering, shift and the calibrated angles
+    if (!store.Calibrate()) return 1;
+    EPMatchIndex epIndex;
+    std::vector<EPPayload> payload;
+    if (!store.BuildIndex(epIndex, payload)) return 1;
+    if (!store.WriteWeights(weightsName)) return 1;
+    if (!WriteEventPlaneCheckpoint(EPfileName, store, payload)) return 1;
+    timer.Stop();
+    std::cout << "Wrote " << weightsName << " and " << EPfileName << " (" << store.GetN()
+              << " EP events) in " << timer.RealTime() << " s" << std::endl;
+
+    if (buildSidecar) {
+        EPMatchIndex sidecar;
+        if (!sidecar.Open(EPfileName)) return 1;
+        std::cout << "Wrote " << EPMatchIndex::SidecarName(EPfileName) << std::endl;
+    }
+    return 0;
+}
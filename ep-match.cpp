@@ -0,0 +1,165 @@
+// ============================================================================
+// ep-match
+//
+// Step 3 as a standalone executable: matching of Lambda files with the EP
+// file and the Lambda selection (MatchLambdaFile of
+// GlobalPolarizationAnalysis_FilePrep.C), one Lambda file per thread as in
+// GlobalPolarizationAnalysis_FilePrepParallel.
+//
+// Usage:
+//   ep-match -e eventplane.root [options] <Lambda file> [...]
+//
+// Input file k (counted from --first) is written to the output format with
+// %d = k. Exits with 1 if any input file could not be matched. Built by the
+// Makefile; set EP_TRACE=trace.json to record a timeline (EPTrace.h).
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#include "GlobalPolarizationAnalysis_FilePrep.C"
+
+#include <TStopwatch.h>
+#include <TROOT.h>
+#include <ROOT/TThreadExecutor.hxx>
+#include <getopt.h>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " -e eventplane.root [options] <Lambda file> [...]\n"
+              << "  -e, --ep FILE          EP file (with -w: step-1 Q-vector tuple)\n"
+              << "  -w, --weights FILE     compute the EP angles from the Q-vectors with this weights file\n"
+              << "  -V, --variants SPEC    further EP variants, \"name:EPfile,name:Qfile:weights,...\"\n"
+              << "  -o, --output FORMAT    output file of input k (default LambdaFile_newPhiEP_%d.root)\n"
+              << "  -n, --first K          number of the first input file (default 0)\n"
+              << "  -j, --threads N        threads (0 = all cores, default 1)\n"
+              << "      --join MODE        hash (default) or merge\n"
+              << "      --cuts MODE        accounting (default) or fast\n"
+              << "      --cut-file FILE    cut table (default LambdaCuts.txt)\n"
+              << "      --output-mode MODE copy (default), friend-entry, friend-angles or flat\n"
+              << "      --no-polarization  do not fill hPolarization\n"
+              << "  -h, --help             print this help" << std::endl;
+}
+
+// Number of integer conversions (%d or %i, with flags and width) in the
+// output format, or -1 if it holds any other conversion; "%%" is a literal %
+int CountIntConversions(const std::string& format) {
+    int n = 0;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%') continue;
+        if (++i < format.size() && format[i] == '%') continue;
+        while (i < format.size() && std::strchr("-+ #0", format[i])) ++i;
+        while (i < format.size() && std::isdigit((unsigned char)format[i])) ++i;
+        if (i == format.size() || (format[i] != 'd' && format[i] != 'i')) return -1;
+        n++;
+    }
+    return n;
+}
+
+// Index of name in names, or -1
+int ParseMode(const char* name, const std::vector<std::string>& names) {
+    for (size_t i = 0; i < names.size(); ++i)
+        if (names[i] == name) return i;
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    std::string EPfileName, epWeightsFile, epVariants;
+    std::string outFormat = "LambdaFile_newPhiEP_%d.root";
+    int firstFile = 0, nThreads = 1;
+    FilePrepOptions options;
+
+    enum { kOptJoin = 256, kOptCuts, kOptCutFile, kOptOutputMode, kOptNoPolarization };
+    static struct option longOptions[] = {
+        {"ep",              required_argument, nullptr, 'e'},
+        {"weights",         required_argument, nullptr, 'w'},
+        {"variants",        required_argument, nullptr, 'V'},
+        {"output",          required_argument, nullptr, 'o'},
+        {"first",           required_argument, nullptr, 'n'},
+        {"threads",         required_argument, nullptr, 'j'},
+        {"join",            required_argument, nullptr, kOptJoin},
+        {"cuts",            required_argument, nullptr, kOptCuts},
+        {"cut-file",        required_argument, nullptr, kOptCutFile},
+        {"output-mode",     required_argument, nullptr, kOptOutputMode},
+        {"no-polarization", no_argument,       nullptr, kOptNoPolarization},
+        {"help",            no_argument,       nullptr, 'h'},
+        {nullptr,           0,                 nullptr, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "e:w:V:o:n:j:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'e': EPfileName = optarg; break;
+            case 'w': epWeightsFile = optarg; break;
+            case 'V': epVariants = optarg; break;
+            case 'o': outFormat = optarg; break;
+            case 'n': firstFile = std::atoi(optarg); break;
+            case 'j': nThreads = std::atoi(optarg); break;
+            case kOptJoin:       options.joinMode = ParseMode(optarg, {"hash", "merge"}); break;
+            case kOptCuts:       options.cutMode = ParseMode(optarg, {"accounting", "fast"}); break;
+            case kOptCutFile:    options.cutFile = optarg; break;
+            case kOptOutputMode: options.outputMode = ParseMode(optarg, {"copy", "friend-entry", "friend-angles", "flat"}); break;
+            case kOptNoPolarization: options.polarization = false; break;
+            case 'h': PrintUsage(argv[0]); return 0;
+            default:  PrintUsage(argv[0]); return 1;
+        }
+    }
+    if (EPfileName.empty() || optind == argc || nThreads < 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.joinMode < 0 || options.cutMode < 0 || options.outputMode < 0) {
+        std::cerr << "Unknown --join, --cuts or --output-mode value." << std::endl;
+        return 1;
+    }
+    std::vector<std::string> fileNames(argv + optind, argv + argc);
+    // The format is passed to Form(): one integer conversion at most
+    int nConversions = CountIntConversions(outFormat);
+    if (nConversions < 0 || nConversions > 1) {
+        std::cerr << "The output format may only hold one %d (and %%): " << outFormat << std::endl;
+        return 1;
+    }
+    if (fileNames.size() > 1 && nConversions == 0) {
+        std::cerr << "The output format needs %d for more than one input file." << std::endl;
+        return 1;
+    }
+
+    // EP index, shared by all workers
+    ROOT::EnableThreadSafety();
+    TStopwatch loadTimer;
+    EPMatchIndex epIndex;
+    if (!OpenEPIndex(epIndex, EPfileName, epWeightsFile)) {
+        std::cerr << "Could not build EP index for: " << EPfileName << std::endl;
+        return 1;
+    }
+    EPVariantSet variants;
+    if (!OpenEPVariants(epVariants, epIndex, variants)) return 1;
+    loadTimer.Stop();
+    std::cout << "Loaded " << epIndex.GetN() << " EP events in " << loadTimer.RealTime() << " s" << std::endl;
+
+    // One Lambda file per task
+    std::atomic<int> nFailed(0);
+    std::vector<int> fileIdx;
+    for (size_t i = 0; i < fileNames.size(); ++i) fileIdx.push_back(i);
+    TStopwatch totalTimer;
+    ROOT::TThreadExecutor pool(nThreads);
+    pool.Foreach([&](int i) {
+        int fileNr = firstFile + i;
+        if (!MatchLambdaFile(fileNames[i], Form(outFormat.c_str(), fileNr), fileNr, EPfileName, epIndex, variants,
+                             options))
+            nFailed++;
+    }, fileIdx);
+    totalTimer.Stop();
+    std::cout << "Processed " << fileNames.size() << " Lambda files on " << pool.GetPoolSize()
+              << " threads in " << totalTimer.RealTime() << " s" << std::endl;
+    if (nFailed > 0) {
+        std::cerr << nFailed << " of " << fileNames.size() << " Lambda files failed." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+// ============================================================================
+// ep-qvectors
+//
+// Step 1 as a standalone executable: Q-vector tuple of VELO AP files
+// (WriteQVectorTuple of EventPlaneAnalysis.cpp).
+//
+// Usage:
+//   ep-qvectors [-o qvectors.root] <AP directory or file> [...]
+//
+// A directory stands for its AP files (GetFilteredRootFiles), a file is read
+// as given. Exits with 1 if the tuple could not be written or any AP file
+// could not be read. Built by the Makefile; set EP_TRACE=trace.json to
+// record a timeline (EPTrace.h).
+//
+// Author: Maria Stefaniak <mzstefaniak@gmail.com>
+// Year: 2025
+// ============================================================================
+
+#include "EventPlaneAnalysis.cpp"
+
+#include <TSystem.h>
+#include <getopt.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void PrintUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [-o qvectors.root] <AP directory or file> [...]\n"
+              << "  -o, --output FILE   Q-vector tuple to write (default event_plane_pbpb.root)\n"
+              << "  -h, --help          print this help" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string outName = "event_plane_pbpb.root";
+
+    static struct option longOptions[] = {
+        {"output", required_argument, nullptr, 'o'},
+        {"help",   no_argument,       nullptr, 'h'},
+        {nullptr,  0,                 nullptr, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "o:h", longOptions, nullptr)) != -1) {
+        switch (c) {
+            case 'o': outName = optarg; break;
+            case 'h': PrintUsage(argv[0]); return 0;
+            default:  PrintUsage(argv[0]); return 1;
+        }
+    }
+    if (optind == argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // Collect the AP files
+    std::vector<std::string> fileNames;
+    for (int i = optind; i < argc; ++i) {
+        FileStat_t stat;
+        if (gSystem->GetPathInfo(argv[i], stat) == 0 && R_ISDIR(stat.fMode)) {
+            std::vector<std::string> dirFiles = GetFilteredRootFiles(argv[i]);
+            fileNames.insert(fileNames.end(), dirFiles.begin(), dirFiles.end());
+        } else {
+            fileNames.push_back(argv[i]);
+        }
+    }
+    if (fileNames.empty()) {
+        std::cerr << "No AP files found." << std::endl;
+        return 1;
+    }
+    std::cout << "Reading " << fileNames.size() << " AP files" << std::endl;
+
+    return WriteQVectorTuple(fileNames, outName) ? 0 : 1;
+}